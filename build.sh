@@ -107,6 +107,7 @@ echo "Toolchain: ${actual_gcc_version}" >&2
 # Circle service kernel --------------------------------------------------------
 build_service() {
   need lz4
+  need gzip
   local stage
   local stage_build
   local prefix_map_flags
@@ -138,6 +139,7 @@ build_service() {
   # The service kernel uses generated headers from both:
   # - webcontent/miniservice/index.h (UI)
   # - webcontent/C64_Pro_Mono-STYLE.h (font payload)
+  # - index.gz.h / C64_Pro_Mono-STYLE.gz.h (gzip-encoded copies, host gzip)
   # Build both generators for service-only builds.
   "${ROOT}/tools/bootstrap-style64-font.sh" >/dev/null
   make -C "${ROOT}/src/webcontent" all >/dev/null
@@ -149,7 +151,7 @@ build_service() {
   local service_circle_objs
   local service_common_objs
   service_circle_objs="service/main.o service/kernel.o"
-  service_common_objs="service/service.o service/http_server.o service/shim.o options.o ScreenLCD.o SSD1306.o xga_font_data.o"
+  service_common_objs="service/service.o service/http_server.o service/crc32.o service/lz4_frame.o service/lz4_vendor.o service/shim.o boot_timeline.o options.o ScreenLCD.o SSD1306.o xga_font_data.o"
 
   echo "service kernel: building (Circle, Pi Zero)" >&2
   make -C "${ROOT}/src" -f Makefile.circle CIRCLEBASE="$stage_build" \
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "lz.h"
+#include "contiguous_file.h"
 #include "Petscii.h"
 #include <malloc.h>
 #if !defined (__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
@@ -354,52 +355,57 @@ bool DiskImage::WriteD64(char* name)
 		return false;
 	}
 
-	FIL fp;
-	FRESULT res = f_open(&fp, fileInfo ? fileInfo->fname : name, FA_CREATE_ALWAYS | FA_WRITE);
-	if (res == FR_OK)
-	{
-		UINT bytesToWrite;
-		UINT bytesWritten;
-
-		unsigned track, sector, sectors;
-		BYTE d64data[MAXBLOCKSONDISK * 256], *d64ptr;
-		int blocks_to_save = 0;
+	UINT bytesToWrite;
+	UINT bytesWritten;
 
-		DEBUG_LOG("Writing D64 file...\r\n");
+	unsigned track, sector, sectors;
+	BYTE d64data[MAXBLOCKSONDISK * 256], *d64ptr;
+	int blocks_to_save = 0;
 
-		memset(d64data, 0, sizeof(d64data));
+	memset(d64data, 0, sizeof(d64data));
 
-		d64ptr = d64data;
-		for (track = 0; track < HALF_TRACK_COUNT; track += 2)
+	d64ptr = d64data;
+	for (track = 0; track < HALF_TRACK_COUNT; track += 2)
+	{
+		if (trackUsed[track])
 		{
-			if (trackUsed[track])
-			{
-				//printf("Track %d\r\n", track);
+			//printf("Track %d\r\n", track);
 
-				sectors = sectorsPerTrack[GetSpeedZoneIndexD64(track >> 1)];
-				for (sector = 0; sector < sectors; sector++)
-				{
-					ConvertSector(track, sector, d64ptr);
-					d64ptr += 256;
-					blocks_to_save++;
-				}
+			sectors = sectorsPerTrack[GetSpeedZoneIndexD64(track >> 1)];
+			for (sector = 0; sector < sectors; sector++)
+			{
+				ConvertSector(track, sector, d64ptr);
+				d64ptr += 256;
+				blocks_to_save++;
 			}
 		}
+	}
+	bytesToWrite = blocks_to_save * 256;
+
+	FIL fp;
+	FRESULT res = ContiguousOpen(&fp, fileInfo ? fileInfo->fname : name, bytesToWrite);
+	if (res == FR_OK)
+	{
+		DEBUG_LOG("Writing D64 file...\r\n");
 
-		bytesToWrite = blocks_to_save * 256;
 		SetACTLed(true);
 		if (f_write(&fp, d64data, bytesToWrite, &bytesWritten) != FR_OK || bytesToWrite != bytesWritten)
 		{
 			SetACTLed(false);
 			DEBUG_LOG("Cannot write d64 data.\r\n");
-			f_close(&fp);
+			ContiguousClose(&fp);
 			return false;
 		}
 
-		f_close(&fp);
+		res = ContiguousClose(&fp);
 
 		//f_utime(fileInfo->fname, fileInfo);
 		SetACTLed(false);
+		if (res != FR_OK)
+		{
+			DEBUG_LOG("Cannot close d64 file.\r\n");
+			return false;
+		}
 
 		DEBUG_LOG("Converted %d blocks into D64 file\r\n", blocks_to_save);
 
@@ -970,8 +976,17 @@ bool DiskImage::WriteG64(char* name)
 	if (readOnly)
 		return true;
 
+	// Header, track and speed offset tables, then one G64_TRACK_MAXLEN + 2
+	// record per stored track.
+	FSIZE_t size = 12 + MAX_HALFTRACKS_1541 * 8;
+	for (int track = 0; track < MAX_HALFTRACKS_1541; ++track)
+	{
+		if (trackLengths[track] != 0 && trackUsed[track])
+			size += G64_TRACK_MAXLEN + 2;
+	}
+
 	FIL fp;
-	FRESULT res = f_open(&fp, fileInfo ? fileInfo->fname : name, FA_CREATE_ALWAYS | FA_WRITE);
+	FRESULT res = ContiguousOpen(&fp, fileInfo ? fileInfo->fname : name, size);
 	if (res == FR_OK)
 	{
 		u32 bytesToWrite;
@@ -1001,7 +1016,7 @@ bool DiskImage::WriteG64(char* name)
 		{
 			SetACTLed(false);
 			DEBUG_LOG("Cannot write G64 header.\r\n");
-			f_close(&fp);
+			ContiguousClose(&fp);
 			return false;
 		}
 		SetACTLed(false);
@@ -1021,8 +1036,13 @@ bool DiskImage::WriteG64(char* name)
 		}
 
 		SetACTLed(true);
-		WriteDwords(&fp, (u32*)gcr_track_p, MAX_HALFTRACKS_1541);
-		WriteDwords(&fp, (u32*)gcr_speed_p, MAX_HALFTRACKS_1541);
+		if (!WriteDwords(&fp, (u32*)gcr_track_p, MAX_HALFTRACKS_1541) || !WriteDwords(&fp, (u32*)gcr_speed_p, MAX_HALFTRACKS_1541))
+		{
+			SetACTLed(false);
+			DEBUG_LOG("Cannot write G64 track tables.\r\n");
+			ContiguousClose(&fp);
+			return false;
+		}
 		SetACTLed(false);
 
 		for (track = 0; track < MAX_HALFTRACKS_1541; track += track_inc)
@@ -1051,13 +1071,17 @@ bool DiskImage::WriteG64(char* name)
 			{
 				SetACTLed(false);
 				DEBUG_LOG("Cannot write track data.\r\n");
-				f_close(&fp);
+				ContiguousClose(&fp);
 				return false;
 			}
 			SetACTLed(false);
 		}
 
-		f_close(&fp);
+		if (ContiguousClose(&fp) != FR_OK)
+		{
+			DEBUG_LOG("Cannot close G64 file.\r\n");
+			return false;
+		}
 		DEBUG_LOG("nSuccessfully saved G64\r\n");
 
 		return true;
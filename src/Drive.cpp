@@ -423,6 +423,18 @@ Drive::Drive()
 	Reset();
 }
 
+void Drive::LoadState(const Drive& saved)
+{
+	DiskImage* insertedImage = diskImage;
+	m6522* connectedVIA = m_pVIA;
+
+	*this = saved;
+	diskImage = insertedImage;
+	m_pVIA = connectedVIA;
+	cachedheadTrackPos = -1;
+	cachedbyteOffset = -1;
+}
+
 void Drive::Reset()
 {
 #if defined(FAST_CODE)
@@ -65,6 +65,9 @@ public:
 	inline const DiskImage* GetDiskImage() const { return diskImage; }
 	void Eject();
 	void Reset();
+	// Takes the head, motor and encoder/decoder state of a drive saved by the
+	// same kernel; keeps the inserted image and the VIA connection.
+	void LoadState(const Drive& saved);
 	inline unsigned Track() const { return headTrackPos; }
 	inline unsigned SectorPos() const { return headBitOffset >> 3; }
 	inline unsigned GetHeadBitOffset() const { return headBitOffset; }
@@ -25,7 +25,6 @@
 #include "debug.h"
 #include "options.h"
 #include "InputMappings.h"
-#include "stb_image.h"
 #include "Petscii.h"
 #if defined(__CIRCLE__)
 const char* VolumeStr[FF_VOLUMES] = {"SD","USB01","USB02","USB03"};
@@ -368,6 +367,7 @@ FileBrowser::BrowsableList::BrowsableList()
 	, scrollHighlightRate(0)
 	, searchPrefixIndex(0)
 	, searchLastKeystrokeTime(0)
+	, searchMatchesLength(0)
 {
 #if defined(__CIRCLE__)
 	lastUpdateTime = Kernel.get_clock_ticks();
@@ -445,7 +445,6 @@ bool FileBrowser::BrowsableList::CheckBrowseNavigation()
 	if (searchChar)
 	{
 		unsigned found=0;
-		u32 i=0;
 
 		searchLastKeystrokeTime = 0;
 
@@ -457,29 +456,13 @@ bool FileBrowser::BrowsableList::CheckBrowseNavigation()
 			dirty |= 1;
 		}
 
-		// first look from next to last
-		for (i=1+currentIndex; i <= numberOfEntriesMinus1 ; i++)
-		{
-			FileBrowser::BrowsableList::Entry* entry = &entries[i];
-			if (strncasecmp(searchPrefix, entry->filImage.fname, searchPrefixIndex) == 0)
-			{
-				found=i;
-				break;
-			}
-		}
-		if (!found)
-		{
-			// look from first to previous
-			for (i=0; i< 1+currentIndex ; i++)
-			{
-				FileBrowser::BrowsableList::Entry* entry = &entries[i];
-				if (strncasecmp(searchPrefix, entry->filImage.fname, searchPrefixIndex) == 0)
-				{
-					found=i;
-					break;
-				}
-			}
-		}
+		int match;
+		if (options.KeyboardSearchSubstring())
+			match = FindSubstring(searchPrefix, searchPrefixIndex, 1 + currentIndex);
+		else
+			match = FindPrefix(searchPrefix, searchPrefixIndex, 1 + currentIndex);
+		if (match > 0)
+			found = match;
 
 		if (found)
 		{
@@ -494,6 +477,8 @@ bool FileBrowser::BrowsableList::CheckBrowseNavigation()
 		{
 			searchPrefixIndex = 0;
 			searchPrefix[0] = 0;
+			searchMatches.clear();
+			searchMatchesLength = 0;
 			searchLastKeystrokeTime = 0;
 			dirty |= 1;
 		}
@@ -515,6 +500,102 @@ bool FileBrowser::BrowsableList::CheckBrowseNavigation()
 	return dirty;
 }
 
+void FileBrowser::BrowsableList::BuildSearchIndex()
+{
+	u32 index;
+
+	sortedRuns.clear();
+	for (index = 0; index < entries.size(); ++index)
+	{
+		if (index == 0 || strcasecmp(entries[index - 1].filImage.fname, entries[index].filImage.fname) > 0)
+			sortedRuns.push_back(index);
+	}
+	sortedRuns.push_back(entries.size());
+}
+
+// Returns the first entry at or after from (wrapping around) whose name starts
+// with prefix, or -1. Each sorted run is binary searched, so a folder listing
+// (".." / folders / files) costs three O(log n) searches per keystroke.
+int FileBrowser::BrowsableList::FindPrefix(const char* prefix, u32 length, u32 from)
+{
+	int next = -1;
+	int first = -1;
+
+	if (sortedRuns.empty() || sortedRuns.back() != entries.size())
+		BuildSearchIndex();
+
+	for (u32 run = 0; run + 1 < sortedRuns.size(); ++run)
+	{
+		u32 runStart = sortedRuns[run];
+		u32 runEnd = sortedRuns[run + 1];
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			u32 low = pass == 0 ? runStart : std::max(runStart, from);
+			u32 high = runEnd;
+			while (low < high)
+			{
+				u32 mid = low + (high - low) / 2;
+				if (strncasecmp(entries[mid].filImage.fname, prefix, length) < 0)
+					low = mid + 1;
+				else
+					high = mid;
+			}
+			if (low < runEnd && strncasecmp(entries[low].filImage.fname, prefix, length) == 0)
+			{
+				int& best = pass == 0 ? first : next;
+				if (best < 0 || (int)low < best)
+					best = low;
+			}
+		}
+	}
+	return next >= 0 ? next : first;
+}
+
+static bool ContainsNoCase(const char* haystack, const char* needle, u32 length)
+{
+	for (; *haystack; ++haystack)
+	{
+		if (strncasecmp(haystack, needle, length) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Returns the first entry at or after from (wrapping around) whose name
+// contains text, or -1. Each keystroke only extends the text, so the previous
+// matches are narrowed instead of rescanning the whole list.
+int FileBrowser::BrowsableList::FindSubstring(const char* text, u32 length, u32 from)
+{
+	u32 index;
+
+	if (length == searchMatchesLength + 1 && searchMatchesLength != 0)
+	{
+		u32 kept = 0;
+		for (index = 0; index < searchMatches.size(); ++index)
+		{
+			if (ContainsNoCase(entries[searchMatches[index]].filImage.fname, text, length))
+				searchMatches[kept++] = searchMatches[index];
+		}
+		searchMatches.resize(kept);
+	}
+	else
+	{
+		searchMatches.clear();
+		for (index = 0; index < entries.size(); ++index)
+		{
+			if (ContainsNoCase(entries[index].filImage.fname, text, length))
+				searchMatches.push_back(index);
+		}
+	}
+	searchMatchesLength = length;
+
+	if (searchMatches.empty())
+		return -1;
+	std::vector<u32>::iterator it = std::lower_bound(searchMatches.begin(), searchMatches.end(), from);
+	return it != searchMatches.end() ? *it : searchMatches.front();
+}
+
 FileBrowser::BrowsableList::Entry* FileBrowser::BrowsableList::FindEntry(const char* name)
 {
 	int index;
@@ -544,6 +625,12 @@ FileBrowser::FileBrowser(InputMappings* inputMappings, DiskCaddy* diskCaddy, ROM
 	, screenLCD(screenLCD)
 	, scrollHighlightRate(scrollHighlightRate)
 	, displayingDevices(false)
+#if not defined(EXPERIMENTALZERO)
+	, thumbnails(PNG_WIDTH, PNG_HEIGHT)
+	, iconPrefetchIndex(0)
+	, iconPrefetchStep(0)
+	, iconPrefetchTime(0)
+#endif
 {
 	folder.scrollHighlightRate = scrollHighlightRate;
 
@@ -647,69 +734,120 @@ void FileBrowser::RefreshDevicesEntries(std::vector<FileBrowser::BrowsableList::
 	}
 }
 
-void FileBrowser::RefreshFolderEntries()
+struct EntryNameIndexLess
+{
+	EntryNameIndexLess(const std::vector<FileBrowser::BrowsableList::Entry>& entries) : entries(entries) {}
+	bool operator()(u32 lhs, u32 rhs) const
+	{
+		return strcasecmp(entries[lhs].filImage.fname, entries[rhs].filImage.fname) < 0;
+	}
+	const std::vector<FileBrowser::BrowsableList::Entry>& entries;
+};
+
+// An icon "name.png" applies to every entry whose name starts with "name".
+// Entries sorted case-insensitively keep all such matches in one contiguous run,
+// so each icon costs a binary search instead of a scan of the whole folder.
+// Icons are applied in directory order so the last one found still wins.
+void FileBrowser::MatchIcons(std::vector<FileBrowser::BrowsableList::Entry>& entries, u32 first, const std::vector<FILINFO>& icons)
+{
+	std::vector<u32> byName(entries.size() - first);
+	for (u32 index = 0; index < byName.size(); ++index)
+		byName[index] = first + index;
+	std::sort(byName.begin(), byName.end(), EntryNameIndexLess(entries));
+
+	for (unsigned iconIndex = 0; iconIndex < icons.size(); ++iconIndex)
+	{
+		const FILINFO& icon = icons[iconIndex];
+		int length = strrchr(icon.fname, '.') - icon.fname;
+
+		u32 low = 0;
+		u32 high = byName.size();
+		while (low < high)
+		{
+			u32 mid = low + (high - low) / 2;
+			if (strncasecmp(entries[byName[mid]].filImage.fname, icon.fname, length) < 0)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+
+		for (; low < byName.size(); ++low)
+		{
+			FileBrowser::BrowsableList::Entry* entryAtIndex = &entries[byName[low]];
+			if (strncasecmp(entryAtIndex->filImage.fname, icon.fname, length) != 0)
+				break;
+			entryAtIndex->filIcon = icon;
+		}
+	}
+}
+
+// Appends the current directory to entries, sorted and with icons matched.
+// Shared with IEC_Commands::LoadDirectory().
+bool FileBrowser::ReadFolderEntries(std::vector<FileBrowser::BrowsableList::Entry>& entries)
 {
 	DIR dir;
 	FileBrowser::BrowsableList::Entry entry;
 	FRESULT res;
 	char* ext;
+	u32 first = entries.size();
+
+	res = f_opendir(&dir, ".");
+	if (res != FR_OK)
+		return false;
+
+	std::vector<FILINFO> icons;
+
+	// Collect images and icons in a single pass over the directory
+	entry.filIcon.fname[0] = 0;
+	do
+	{
+		res = f_readdir(&dir, &entry.filImage);
+		if (res != FR_OK || entry.filImage.fname[0] == 0)
+			break;
+		ext = strrchr(entry.filImage.fname, '.');
+		if (ext && strcasecmp(ext, ".png") == 0)
+			icons.push_back(entry.filImage);
+		else if (entry.filImage.fname[0] != '.')
+			entries.push_back(entry);
+	} while (res == FR_OK);
+	f_closedir(&dir);
+
+	if (icons.size())
+		MatchIcons(entries, first, icons);
+
+	std::sort(entries.begin() + first, entries.end(), greater());
+	return true;
+}
+
+void FileBrowser::RefreshFolderEntries()
+{
+	FileBrowser::BrowsableList::Entry entry;
 
 	folder.Clear();
+#if not defined(EXPERIMENTALZERO)
+	thumbnails.Clear();
+#endif
 	if (displayingDevices)
 	{
 		FileBrowser::RefreshDevicesEntries(folder.entries, false);
 	}
 	else
 	{
-		res = f_opendir(&dir, ".");
-		if (res == FR_OK)
-		{
-			do
-			{
-				res = f_readdir(&dir, &entry.filImage);
-				ext = strrchr(entry.filImage.fname, '.');
-				if (res == FR_OK && entry.filImage.fname[0] != 0 && !(ext && strcasecmp(ext, ".png") == 0) && (entry.filImage.fname[0] != '.'))
-					folder.entries.push_back(entry);
-			} while (res == FR_OK && entry.filImage.fname[0] != 0);
-			f_closedir(&dir);
-
-			// Now check for icons
-			res = f_opendir(&dir, ".");
-			if (res == FR_OK)/* XXX Fixme */
-			{
-				do
-				{
-					res = f_readdir(&dir, &entry.filIcon);
-					ext = strrchr(entry.filIcon.fname, '.');
-					if (ext)
-					{
-						int length = ext - entry.filIcon.fname;
-						if (res == FR_OK && entry.filIcon.fname[0] != 0 && strcasecmp(ext, ".png") == 0)
-						{
-							for (unsigned index = 0; index < folder.entries.size(); ++index)
-							{
-								FileBrowser::BrowsableList::Entry* entryAtIndex = &folder.entries[index];
-								if (strncasecmp(entry.filIcon.fname, entryAtIndex->filImage.fname, length) == 0)
-									entryAtIndex->filIcon = entry.filIcon;
-							}
-						}
-					}
-				} while (res == FR_OK && entry.filIcon.fname[0] != 0);
-			}
-			f_closedir(&dir);
-
-			strcpy(entry.filImage.fname, "..");
-			entry.filImage.fattrib |= AM_DIR;
-			entry.filIcon.fname[0] = 0;
-			folder.entries.push_back(entry);
-
-			std::sort(folder.entries.begin(), folder.entries.end(), greater());
+		strcpy(entry.filImage.fname, "..");
+		entry.filImage.fsize = 0;
+		entry.filImage.fattrib = AM_DIR;
+		entry.filIcon.fname[0] = 0;
+		folder.entries.push_back(entry);
 
+		if (ReadFolderEntries(folder.entries))
+		{
+			folder.BuildSearchIndex();
 			folder.currentIndex = 0;
 			folder.SetCurrent();
 		}
 		else
 		{
+			folder.entries.clear();
 			//DEBUG_LOG("Cannot open dir");
 			printf("%s: can't open cwd\n", __FUNCTION__);
 		}
@@ -874,51 +1012,32 @@ bool FileBrowser::CheckForPNG(const char* filename, FILINFO& filIcon)
 	return foundValid;
 }
 
-void FileBrowser::DisplayPNG(FILINFO& filIcon, int x, int y)
+#if not defined(EXPERIMENTALZERO)
+static u32 BrowserTicks()
 {
-	if (filIcon.fname[0] != 0)
-	{
-		FIL fp;
-		FRESULT res;
+#if defined(__CIRCLE__)
+	return Kernel.get_clock_ticks();
+#elif defined(__PICO2__)
+	return time_us_32();
+#else
+	return read32(ARM_SYSTIMER_CLO);
+#endif
+}
+#endif
 
-		res = f_open(&fp, filIcon.fname, FA_READ);
-		if (res == FR_OK)
-		{
-			char* PNG = (char*)malloc(filIcon.fsize);
-			if (PNG)
-			{
-				UINT bytesRead;
-				SetACTLed(true);
-				f_read(&fp, PNG, filIcon.fsize, &bytesRead);
-				SetACTLed(false);
-				f_close(&fp);
-
-				int w;
-				int h;
-				int channels_in_file;
-				stbi_uc* image = stbi_load_from_memory((stbi_uc const*)PNG, bytesRead, &w, &h, &channels_in_file, 4);
+void FileBrowser::DisplayPNG(FILINFO& filIcon, int x, int y)
+{
 #if not defined(EXPERIMENTALZERO)
-				if (image && (w <= PNG_WIDTH && h <= PNG_HEIGHT))
-				{
-					//DEBUG_LOG("Opened PNG %s w = %d h = %d cif = %d\r\n", filIcon.fname, w, h, channels_in_file);
-					int offsx, offsy;
-					offsx = (PNG_WIDTH - w) / 2;
-					offsy = (PNG_HEIGHT - h) / 2;
-					screenMain->PlotImage((u32*)image, x + offsx, y + offsy, w, h);
-				}
-				else
-				{
-					DEBUG_LOG("Invalid PNG size %d x %d\r\n", w, h);
-				}
-#endif
-				free(PNG);
-			}
-		}
-	}
-	else
+	const ThumbnailCache::Thumbnail* thumbnail = thumbnails.Get(filIcon);
+	if (thumbnail && thumbnail->pixels)
 	{
-		//DEBUG_LOG("%s: Cannot find PNG %s\r\n", __FUNCTION__, filIcon.fname);
+		//DEBUG_LOG("Opened PNG %s w = %d h = %d\r\n", filIcon.fname, thumbnail->width, thumbnail->height);
+		int offsx, offsy;
+		offsx = (PNG_WIDTH - thumbnail->width) / 2;
+		offsy = (PNG_HEIGHT - thumbnail->height) / 2;
+		screenMain->PlotImage(thumbnail->pixels, x + offsx, y + offsy, thumbnail->width, thumbnail->height);
 	}
+#endif
 }
 
 void FileBrowser::DisplayPNG()
@@ -930,6 +1049,34 @@ void FileBrowser::DisplayPNG()
 		u32 x = screenMain->ScaleX(1024) - PNG_WIDTH;
 		u32 y = screenMain->ScaleY(616) - PNG_HEIGHT;
 		DisplayPNG(current->filIcon, x, y);
+
+		iconPrefetchIndex = folder.currentIndex;
+		iconPrefetchStep = 0;
+		iconPrefetchTime = BrowserTicks();
+	}
+#endif
+}
+
+// Decode the icons either side of the highlight while the user is idle, one
+// per call, so the next step up or down is drawn straight from the cache.
+void FileBrowser::PrefetchPNG()
+{
+#if not defined(EXPERIMENTALZERO)
+	static const u32 idleMicroseconds = 250000;
+
+	if (!displayPNGIcons || iconPrefetchStep >= 2 || folder.currentIndex != iconPrefetchIndex)
+		return;
+	if (BrowserTicks() - iconPrefetchTime < idleMicroseconds)
+		return;
+
+	u32 count = folder.entries.size();
+	u32 index = iconPrefetchStep == 0 ? iconPrefetchIndex + 1 : iconPrefetchIndex + count - 1;
+	iconPrefetchStep++;
+	if (count > 1)
+	{
+		FILINFO& filIcon = folder.entries[index % count].filIcon;
+		if (filIcon.fname[0] && !thumbnails.Contains(filIcon))
+			thumbnails.Get(filIcon);
 	}
 #endif
 }
@@ -1052,6 +1199,8 @@ void FileBrowser::Update()
 {
 	if ( inputMappings->CheckKeyboardBrowseMode() || inputMappings->CheckButtonsBrowseMode() || (folder.searchPrefixIndex != 0) )
 		UpdateInputFolders();
+	else
+		PrefetchPNG();
 
 	UpdateCurrentHighlight();
 }
@@ -36,6 +36,7 @@
 #include "ROMs.h"
 #include "ScreenBase.h"
 #include "InputMappings.h"
+#include "ThumbnailCache.h"
 
 #define VIC2_COLOUR_INDEX_BLACK		0
 #define VIC2_COLOUR_INDEX_WHITE		1
@@ -112,6 +113,9 @@ public:
 		{
 			u32 index;
 			entries.clear();
+			sortedRuns.clear();
+			searchMatches.clear();
+			searchMatchesLength = 0;
 			current = 0;
 			currentIndex = 0;
 			for (index = 0; index < views.size(); ++index)
@@ -159,6 +163,10 @@ public:
 		Entry* FindEntry(const char* name);
 		int FindNextAutoName(char* basename);
 
+		void BuildSearchIndex();
+		int FindPrefix(const char* prefix, u32 length, u32 from);
+		int FindSubstring(const char* text, u32 length, u32 from);
+
 		void RefreshViews();
 		void RefreshViewsHighlightScroll();
 		bool CheckBrowseNavigation();
@@ -174,6 +182,15 @@ public:
 		char searchPrefix[KEYBOARD_SEARCH_BUFFER_SIZE];
 		u32 searchPrefixIndex;
 		u32 searchLastKeystrokeTime;
+
+		// Start of each run of entries sorted case-insensitively by name, plus
+		// the end of the list. Lets prefix search binary search each run.
+		std::vector<u32> sortedRuns;
+		// Entries containing the first searchMatchesLength characters of
+		// searchPrefix (substring search narrows this on every keystroke).
+		std::vector<u32> searchMatches;
+		u32 searchMatchesLength;
+
 		std::vector<BrowsableListView> views;
 	};
 
@@ -211,6 +228,7 @@ public:
 	static u32 Colour(int index);
 
 	static void RefreshDevicesEntries(std::vector<FileBrowser::BrowsableList::Entry>& entries, bool toLower);
+	static bool ReadFolderEntries(std::vector<FileBrowser::BrowsableList::Entry>& entries);
 
 	bool MakeLST(const char* filenameLST);
 	bool MakeLSTFromDir(const char* dir, const char *lstfn);
@@ -223,6 +241,7 @@ public:
 private:
 	void DisplayPNG(FILINFO& filIcon, int x, int y);
 	void RefreshFolderEntries();
+	static void MatchIcons(std::vector<FileBrowser::BrowsableList::Entry>& entries, u32 first, const std::vector<FILINFO>& icons);
 
 	void UpdateInputFolders();
 	//void UpdateInputDiskCaddy();
@@ -236,6 +255,7 @@ private:
 
 	bool CheckForPNG(const char* filename, FILINFO& filIcon);
 	void DisplayPNG();
+	void PrefetchPNG();
 
 	bool SelectROMOrDevice(u32 index);
 
@@ -267,5 +287,14 @@ private:
 	float scrollHighlightRate;
 
 	bool displayingDevices;
+
+#if not defined(EXPERIMENTALZERO)
+	ThumbnailCache thumbnails;
+	// Neighbours of this entry are decoded into thumbnails once the
+	// highlight has rested for a moment.
+	u32 iconPrefetchIndex;
+	u32 iconPrefetchStep;
+	u32 iconPrefetchTime;
+#endif
 };
 #endif
@@ -39,6 +39,8 @@ public:
 	inline unsigned char GetDirection() { return direction; }
 	inline void SetDirection(unsigned char value) { direction = value; if (portOutFn) (portOutFn)(portOutFnThis, stateOut & direction); }
 	inline void SetPortOut(void* data, PortOutFn fn) { portOutFnThis = data; portOutFn = fn; }
+	// Takes the pin state of a saved port; keeps the output connection.
+	inline void LoadState(const IOPort& saved) { stateOut = saved.stateOut; stateIn = saved.stateIn; direction = saved.direction; }
 private:
 	unsigned char stateOut;
 	unsigned char stateIn;
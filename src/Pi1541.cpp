@@ -20,6 +20,7 @@
 #include "debug.h"
 #include "options.h"
 #include "ROMs.h"
+#include <string.h>
 
 extern Options options;
 extern Pi1541 pi1541;
@@ -193,6 +194,46 @@ void Pi1541::Update()
 	VIA[0].Execute();
 }
 
+static inline unsigned StateAlign(unsigned size)
+{
+	return (size + 7) & ~7u;
+}
+
+unsigned Pi1541::StateSize()
+{
+	return StateAlign(sizeof(M6502)) + 2 * StateAlign(sizeof(m6522)) + StateAlign(sizeof(Drive));
+}
+
+void Pi1541::SaveState(u8* state) const
+{
+	memcpy(state, &m6502, sizeof(M6502));
+	state += StateAlign(sizeof(M6502));
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		memcpy(state, &VIA[i], sizeof(m6522));
+		state += StateAlign(sizeof(m6522));
+	}
+	memcpy(state, &drive, sizeof(Drive));
+}
+
+void Pi1541::LoadState(const u8* state)
+{
+	m6502.LoadState(*reinterpret_cast<const M6502*>(state));
+	state += StateAlign(sizeof(M6502));
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		VIA[i].LoadState(*reinterpret_cast<const m6522*>(state));
+		state += StateAlign(sizeof(m6522));
+	}
+	drive.LoadState(*reinterpret_cast<const Drive*>(state));
+
+	// IEC_Bus only learns what port B drives when the VIA writes it, and
+	// Reset() left every line released: hand it the restored pins, so a drive
+	// that was holding DATA or CLK holds them again.
+	IOPort* portB = VIA[0].GetPortB();
+	IEC_Bus::PortB_OnPortOut(0, portB->GetOutput() & portB->GetDirection());
+}
+
 void Pi1541::Reset()
 {
 	IOPort* VIABortB;
@@ -35,6 +35,13 @@ public:
 
 	void Reset();
 
+	// Raw copies of the CPU, both VIAs and the drive mechanics, for the
+	// snapshot kept across a service round trip (see emu_snapshot.h). They
+	// hold code pointers, so only the kernel that saved them can load them.
+	static unsigned StateSize();
+	void SaveState(u8* state) const;
+	void LoadState(const u8* state);
+
 	//void ConfigureOfExtraRAM(bool extraRAM);
 
 	Drive drive;
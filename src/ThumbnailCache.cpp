@@ -0,0 +1,172 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include <string.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "ThumbnailCache.h"
+#if not defined(EXPERIMENTALZERO)
+#include "debug.h"
+#include "stb_image.h"
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+extern "C"
+{
+#include "rpi-gpio.h"	// For SetACTLed
+}
+#endif
+
+ThumbnailCache::ThumbnailCache(u32 maxWidth, u32 maxHeight)
+	: maxWidth(maxWidth)
+	, maxHeight(maxHeight)
+	, useCounter(0)
+{
+	memset(slots, 0, sizeof(slots));
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+	Clear();
+}
+
+void ThumbnailCache::Clear()
+{
+	for (unsigned index = 0; index < THUMBNAIL_CACHE_SLOTS; ++index)
+	{
+		free(slots[index].pixels);
+		memset(&slots[index], 0, sizeof(Thumbnail));
+	}
+}
+
+ThumbnailCache::Thumbnail* ThumbnailCache::Find(const FILINFO& filIcon) const
+{
+	for (unsigned index = 0; index < THUMBNAIL_CACHE_SLOTS; ++index)
+	{
+		const Thumbnail* slot = &slots[index];
+		if (slot->name[0] && slot->fileSize == (u32)filIcon.fsize && strcmp(slot->name, filIcon.fname) == 0)
+			return const_cast<Thumbnail*>(slot);
+	}
+	return 0;
+}
+
+bool ThumbnailCache::Contains(const FILINFO& filIcon) const
+{
+	return Find(filIcon) != 0;
+}
+
+ThumbnailCache::Thumbnail* ThumbnailCache::Evict()
+{
+	Thumbnail* oldest = &slots[0];
+	for (unsigned index = 0; index < THUMBNAIL_CACHE_SLOTS; ++index)
+	{
+		Thumbnail* slot = &slots[index];
+		if (slot->name[0] == 0)
+			return slot;
+		if (slot->lastUsed < oldest->lastUsed)
+			oldest = slot;
+	}
+	free(oldest->pixels);
+	memset(oldest, 0, sizeof(Thumbnail));
+	return oldest;
+}
+
+const ThumbnailCache::Thumbnail* ThumbnailCache::Get(const FILINFO& filIcon)
+{
+	if (filIcon.fname[0] == 0)
+		return 0;
+
+	Thumbnail* slot = Find(filIcon);
+	if (!slot)
+	{
+		slot = Evict();
+		strncpy(slot->name, filIcon.fname, sizeof(slot->name) - 1);
+		slot->fileSize = (u32)filIcon.fsize;
+		if (!Decode(filIcon, slot))
+			DEBUG_LOG("Invalid PNG %s\r\n", filIcon.fname);
+	}
+	slot->lastUsed = ++useCounter;
+	return slot;
+}
+
+bool ThumbnailCache::Decode(const FILINFO& filIcon, Thumbnail* slot)
+{
+	FIL fp;
+	if (f_open(&fp, filIcon.fname, FA_READ) != FR_OK)
+		return false;
+
+	char* PNG = (char*)malloc(filIcon.fsize);
+	if (!PNG)
+	{
+		f_close(&fp);
+		return false;
+	}
+
+	UINT bytesRead;
+	SetACTLed(true);
+	f_read(&fp, PNG, filIcon.fsize, &bytesRead);
+	SetACTLed(false);
+	f_close(&fp);
+
+	int w;
+	int h;
+	int channels_in_file;
+	stbi_uc* image = stbi_load_from_memory((stbi_uc const*)PNG, bytesRead, &w, &h, &channels_in_file, 4);
+	free(PNG);
+	if (!image || w <= 0 || h <= 0)
+	{
+		stbi_image_free(image);
+		return false;
+	}
+
+	if ((u32)w <= maxWidth && (u32)h <= maxHeight)
+	{
+		slot->pixels = (u32*)image;
+		slot->width = w;
+		slot->height = h;
+		return true;
+	}
+
+	// Too big for the icon area: shrink once here (nearest neighbour, keeping
+	// the aspect ratio) rather than refusing to show it.
+	u32 width = maxWidth;
+	u32 height = (u32)((u64)h * maxWidth / w);
+	if (height > maxHeight)
+	{
+		height = maxHeight;
+		width = (u32)((u64)w * maxHeight / h);
+	}
+	if (width == 0) width = 1;
+	if (height == 0) height = 1;
+
+	u32* pixels = (u32*)malloc(width * height * sizeof(u32));
+	if (pixels)
+	{
+		const u32* source = (const u32*)image;
+		for (u32 y = 0; y < height; ++y)
+		{
+			const u32* row = source + (u64)y * h / height * w;
+			for (u32 x = 0; x < width; ++x)
+				pixels[y * width + x] = row[(u64)x * w / width];
+		}
+		slot->pixels = pixels;
+		slot->width = width;
+		slot->height = height;
+	}
+	stbi_image_free(image);
+	return pixels != 0;
+}
+#endif
@@ -0,0 +1,74 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#if !defined(__CIRCLE__)
+#if defined(__PICO2__) || defined(ESP32)
+#include "ff.h"
+#else
+#include "ff-local.h"
+#endif
+#endif
+#include "types.h"
+
+// Small LRU of decoded file browser icons. Icons are decoded once to RGBA,
+// shrunk to fit maxWidth x maxHeight, and kept until evicted or the folder
+// changes, so moving the highlight back and forth never re-reads or
+// re-decodes a PNG. Failed decodes are remembered too.
+// Icons are only drawn on the HDMI screen, which EXPERIMENTALZERO builds
+// compile out, so the cache is compiled out with it.
+#if not defined(EXPERIMENTALZERO)
+#define THUMBNAIL_CACHE_SLOTS 8
+
+class ThumbnailCache
+{
+public:
+	struct Thumbnail
+	{
+		char name[256];
+		u32 fileSize;
+		u32 width;
+		u32 height;
+		u32* pixels;		// 0 if the icon could not be decoded
+		u32 lastUsed;
+	};
+
+	ThumbnailCache(u32 maxWidth, u32 maxHeight);
+	~ThumbnailCache();
+
+	// Icon names are relative to the current directory; call Clear() on
+	// every directory change.
+	const Thumbnail* Get(const FILINFO& filIcon);
+	bool Contains(const FILINFO& filIcon) const;
+	void Clear();
+
+private:
+	Thumbnail* Find(const FILINFO& filIcon) const;
+	Thumbnail* Evict();
+	bool Decode(const FILINFO& filIcon, Thumbnail* slot);
+
+	Thumbnail slots[THUMBNAIL_CACHE_SLOTS];
+	u32 maxWidth;
+	u32 maxHeight;
+	u32 useCounter;
+};
+#endif
+
+#endif
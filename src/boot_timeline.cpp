@@ -0,0 +1,130 @@
+// boot_timeline.cpp
+//
+// See boot_timeline.h.
+
+#include "boot_timeline.h"
+
+#if defined(__CIRCLE__)
+#include <circle/timer.h>
+#include <fatfs/ff.h>
+#else
+#include "ff-local.h"
+extern "C" {
+#include "rpiHardware.h"
+}
+#endif
+
+#include <string.h>
+
+static BootTimelineRecord s_record = { BOOT_TIMELINE_MAGIC, BOOT_TIMELINE_VERSION, 0, {} };
+
+unsigned BootTimelineNow(void)
+{
+#if defined(__CIRCLE__)
+	return CTimer::GetClockTicks();
+#else
+	return read32(ARM_SYSTIMER_CLO);
+#endif
+}
+
+void BootTimelineMarkAt(unsigned phase, unsigned us, unsigned value)
+{
+	if (s_record.count >= BOOT_TIMELINE_MAX)
+		return;
+
+	BootTimelineEntry &entry = s_record.entries[s_record.count++];
+	entry.phase = (uint16_t)phase;
+	entry.reserved = 0;
+	entry.us = us;
+	entry.value = value;
+}
+
+void BootTimelineMark(unsigned phase, unsigned value)
+{
+	BootTimelineMarkAt(phase, BootTimelineNow(), value);
+}
+
+bool BootTimelineLoad(void)
+{
+	// Marks taken before the load (e.g. the stage's own start) are kept and
+	// appended after the loaded ones.
+	BootTimelineRecord own = s_record;
+
+	FIL file;
+	if (f_open(&file, BOOT_TIMELINE_PATH, FA_READ) != FR_OK)
+		return false;
+	BootTimelineRecord loaded;
+	UINT br = 0;
+	const FRESULT res = f_read(&file, &loaded, sizeof(loaded), &br);
+	f_close(&file);
+
+	if (res != FR_OK || br != sizeof(loaded) || loaded.magic != BOOT_TIMELINE_MAGIC ||
+	    loaded.version != BOOT_TIMELINE_VERSION || loaded.count > BOOT_TIMELINE_MAX)
+		return false;
+	const unsigned now = BootTimelineNow();
+	for (unsigned i = 0; i < loaded.count; ++i)
+	{
+		if (loaded.entries[i].us > now)
+			return false;
+	}
+
+	s_record = loaded;
+	for (unsigned i = 0; i < own.count; ++i)
+		BootTimelineMarkAt(own.entries[i].phase, own.entries[i].us, own.entries[i].value);
+	return true;
+}
+
+bool BootTimelineSave(void)
+{
+	FIL file;
+	if (f_open(&file, BOOT_TIMELINE_PATH, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	UINT bw = 0;
+	const FRESULT res = f_write(&file, &s_record, sizeof(s_record), &bw);
+	f_close(&file);
+	return res == FR_OK && bw == sizeof(s_record);
+}
+
+const BootTimelineRecord *BootTimelineGet(void)
+{
+	return &s_record;
+}
+
+const char *BootTimelinePhaseName(unsigned phase)
+{
+	switch (phase)
+	{
+	case BOOT_PHASE_EMU_START:			return "emu_start";
+	case BOOT_PHASE_EMU_FAT_MOUNT:			return "emu_fat_mount";
+	case BOOT_PHASE_EMU_OPTIONS:			return "emu_options";
+	case BOOT_PHASE_EMU_LCD:			return "emu_lcd";
+	case BOOT_PHASE_EMU_ROM_LOAD:			return "emu_rom_load";
+	case BOOT_PHASE_EMU_ACTIVE_LIST:		return "emu_active_list";
+	case BOOT_PHASE_EMU_CADDY_INSERT:		return "emu_caddy_insert";
+	case BOOT_PHASE_EMU_SERVICE_REQUEST:		return "emu_service_request";
+	case BOOT_PHASE_EMU_CHAINLOADER_READ:		return "emu_chainloader_read";
+	case BOOT_PHASE_EMU_SNAPSHOT_RESTORE:		return "emu_snapshot_restore";
+	case BOOT_PHASE_CHAIN_START:			return "chain_start";
+	case BOOT_PHASE_CHAIN_FAT_MOUNT:		return "chain_fat_mount";
+	case BOOT_PHASE_CHAIN_KERNEL_READ:		return "chain_kernel_read";
+	case BOOT_PHASE_CHAIN_KERNEL_DECOMPRESS:	return "chain_kernel_decompress";
+	case BOOT_PHASE_CHAIN_KERNEL_LOADED:		return "chain_kernel_loaded";
+	case BOOT_PHASE_SRV_START:			return "srv_start";
+	case BOOT_PHASE_SRV_FAT_MOUNT:			return "srv_fat_mount";
+	case BOOT_PHASE_SRV_OPTIONS:			return "srv_options";
+	case BOOT_PHASE_SRV_WLAN_INIT:			return "srv_wlan_init";
+	case BOOT_PHASE_SRV_WLAN_UP:			return "srv_wlan_up";
+	case BOOT_PHASE_SRV_DHCP:			return "srv_dhcp";
+	case BOOT_PHASE_SRV_HTTP_READY:			return "srv_http_ready";
+	default:					return 0;
+	}
+}
+
+const char *BootTimelineStageName(unsigned phase)
+{
+	if (phase >= BOOT_PHASE_SRV_START)
+		return "service";
+	if (phase >= BOOT_PHASE_CHAIN_START)
+		return "chainloader";
+	return "emulator";
+}
@@ -0,0 +1,90 @@
+// boot_timeline.h
+//
+// Boot-phase timeline shared by the emulator, chainloader and service kernels.
+//
+// Each stage marks its phases (phase id + ARM system timer microseconds, which
+// count from power-up and are not reset by a chainboot, so stamps of all three
+// kernels are comparable). Before handing over, a stage saves the record to
+// SD:/pi1541_boottime.bin; the next stage loads it and keeps appending. The
+// service kernel saves the complete record once HTTP is up and serves it at
+// GET /boottime.
+
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <stdint.h>
+
+#define BOOT_TIMELINE_PATH "SD:/pi1541_boottime.bin"
+#define BOOT_TIMELINE_MAGIC 0x4C544231u	// "1BTL"
+#define BOOT_TIMELINE_VERSION 1
+#define BOOT_TIMELINE_MAX 32
+
+// Values are stored in the log: append only, never renumber.
+enum BootPhase
+{
+	BOOT_PHASE_NONE = 0,
+
+	// Emulator kernel
+	BOOT_PHASE_EMU_START = 1,
+	BOOT_PHASE_EMU_FAT_MOUNT = 2,
+	BOOT_PHASE_EMU_OPTIONS = 3,
+	BOOT_PHASE_EMU_LCD = 4,
+	BOOT_PHASE_EMU_ROM_LOAD = 5,
+	BOOT_PHASE_EMU_ACTIVE_LIST = 6,		// value: ACTIVE.LST bytes
+	BOOT_PHASE_EMU_CADDY_INSERT = 7,	// value: images in the caddy
+	BOOT_PHASE_EMU_SERVICE_REQUEST = 8,	// value: 0 = no ACTIVE.LST, 1 = long-press
+	BOOT_PHASE_EMU_CHAINLOADER_READ = 9,	// value: chainloader bytes
+	BOOT_PHASE_EMU_SNAPSHOT_RESTORE = 10,	// emulation resumed from the service snapshot
+
+	// Chainloader
+	BOOT_PHASE_CHAIN_START = 20,
+	BOOT_PHASE_CHAIN_FAT_MOUNT = 21,
+	BOOT_PHASE_CHAIN_KERNEL_READ = 22,	// value: us spent reading
+	BOOT_PHASE_CHAIN_KERNEL_DECOMPRESS = 23,	// value: us spent decompressing
+	BOOT_PHASE_CHAIN_KERNEL_LOADED = 24,	// value: kernel bytes
+
+	// Service kernel
+	BOOT_PHASE_SRV_START = 40,
+	BOOT_PHASE_SRV_FAT_MOUNT = 41,
+	BOOT_PHASE_SRV_OPTIONS = 42,
+	BOOT_PHASE_SRV_WLAN_INIT = 43,
+	BOOT_PHASE_SRV_WLAN_UP = 44,
+	BOOT_PHASE_SRV_DHCP = 45,		// value: 1 = DHCP, 0 = static IPv4
+	BOOT_PHASE_SRV_HTTP_READY = 46
+};
+
+struct BootTimelineEntry
+{
+	uint16_t phase;
+	uint16_t reserved;
+	uint32_t us;		// ARM system timer (CLO)
+	uint32_t value;		// phase specific, see BootPhase
+};
+
+struct BootTimelineRecord
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+	BootTimelineEntry entries[BOOT_TIMELINE_MAX];
+};
+
+unsigned BootTimelineNow(void);
+
+// Full records drop further marks.
+void BootTimelineMark(unsigned phase, unsigned value = 0);
+void BootTimelineMarkAt(unsigned phase, unsigned us, unsigned value = 0);
+
+// Continues the record the previous stage saved. A missing, foreign or stale
+// one (stamped later than now, i.e. from before a reboot) starts a new record.
+bool BootTimelineLoad(void);
+bool BootTimelineSave(void);
+
+const BootTimelineRecord *BootTimelineGet(void);
+
+// "emu_start", ... or 0 for unknown ids; stage is "emulator", "chainloader"
+// or "service".
+const char *BootTimelinePhaseName(unsigned phase);
+const char *BootTimelineStageName(unsigned phase);
+
+#endif
@@ -6,6 +6,7 @@
 
 #include <string.h>
 
+#include "boot_timeline.h"
 #include "chainboot_legacy.h"
 #include "diskio.h"
 #include "emmc.h"
@@ -54,6 +55,7 @@ extern "C" void kernel_main(unsigned int r0, unsigned int r1, unsigned int atags
 	(void)r0;
 	(void)r1;
 	(void)atags;
+	const unsigned start = BootTimelineNow();
 
 	// Bring up SD (EMMC) and mount FatFS.
 	g_emmc.Initialize();
@@ -63,6 +65,11 @@ extern "C" void kernel_main(unsigned int r0, unsigned int r1, unsigned int atags
 		while (1) { }
 	}
 
+	// Continue the emulator's boot timeline.
+	BootTimelineLoad();
+	BootTimelineMarkAt(BOOT_PHASE_CHAIN_START, start);
+	BootTimelineMark(BOOT_PHASE_CHAIN_FAT_MOUNT);
+
 	// Match the emulator defaults for performance before the large read.
 	enable_MMU_and_IDCaches();
 	_enable_unaligned_access();
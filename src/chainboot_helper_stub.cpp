@@ -8,6 +8,7 @@
 
 #include "chainboot_helper_stub.h"
 
+#include "boot_timeline.h"
 #include "ff-local.h"
 extern "C" {
 #include "startup.h"
@@ -68,6 +69,10 @@ extern "C" void ChainBootChainloader(const char* chainloaderName)
 	if (!ReadChainloaderRaw(chainloaderName, reinterpret_cast<unsigned char*>(kChainloaderAddr), &fileSize))
 		return;
 
+	// The chainloader continues this record.
+	BootTimelineMark(BOOT_PHASE_EMU_CHAINLOADER_READ, fileSize);
+	BootTimelineSave();
+
 	_disable_interrupts();
 	_data_memory_barrier();
 	_clean_invalidate_dcache();
@@ -3,11 +3,13 @@
 // Load a service kernel image into 0x8000 and chainboot to it.
 // Supported inputs:
 // - raw kernel image (e.g. /kernel_srv.img)
-// - legacy LZ4 stream (e.g. /kernel_srv.lz4), tried first when available
+// - legacy LZ4 stream (e.g. /kernel_srv.lz4), tried first when available,
+//   decompressed in place inside the 0x8000 window
 //
 // This is used by the legacy chainloader kernel only (not linked into the
 // cycle-exact emulator build).
 #include "chainboot_legacy.h"
+#include "boot_timeline.h"
 #include "ff-local.h"
 extern "C" {
 #include "startup.h"
@@ -15,11 +17,12 @@ extern "C" {
 #include "rpiHardware.h"
 }
 #include <string.h>
-#include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 
 #include "lz4_legacy.h"
+#define LZ4_STATIC_LINKING_ONLY	// LZ4_DECOMPRESS_INPLACE_MARGIN
+#include "lz4.h"
 
 // Where the Circle service kernel expects to start.
 static const unsigned kServiceEntryAddr = 0x8000;
@@ -172,16 +175,28 @@ static int ReadKernelFileRaw(const char* kernelName, unsigned char* dest, unsign
 
 #if defined(PI1541_CHAINBOOT_HELPER)
 	HelperLogKV("raw_read_ok", t_read0, now_us(), bytesRead, 0);
+	BootTimelineMark(BOOT_PHASE_CHAIN_KERNEL_READ, delta_us(t_read0, now_us()));
 #endif
 	*outSize = fileSize;
 	return 1;
 }
 
+static uint32_t GetLE32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// The whole compressed stream is read into the top of the destination window
+// and decompressed in place towards 0x8000 (no heap, no per-block buffers).
+// Reads are whole 256 KiB chunks from a sector-aligned file offset, so FatFs
+// hands them to the card as multi-sector transfers straight into place; every
+// block already complete is decompressed before the next chunk is read. The
+// polled EMMC driver cannot read in the background, so a read and a
+// decompression never actually run at the same time.
 static int ReadKernelFileLz4Legacy(const char* kernelName, unsigned char* dest, unsigned int* outSize)
 {
 	FIL file;
 	FRESULT res;
-	UINT br = 0;
 	char line0[32];
 	char line1[32];
 
@@ -202,22 +217,24 @@ static int ReadKernelFileLz4Legacy(const char* kernelName, unsigned char* dest,
 	snprintf(line1, sizeof(line1), "OPEN %s", kernelName);
 	ChainbootShow2(line0, line1);
 
-	uint32_t magic = 0;
-	res = f_read(&file, &magic, sizeof(magic), &br);
-	if (res != FR_OK || br != sizeof(magic) || magic != kLz4LegacyMagic)
+	const unsigned int fileSize = f_size(&file);
+	// Output may not come closer than this to the input it has not consumed yet.
+	const unsigned int margin = LZ4_DECOMPRESS_INPLACE_MARGIN(kMaxKernelSize);
+	if (fileSize < sizeof(kLz4LegacyMagic) || fileSize > kMaxKernelSize - margin)
 	{
-		ChainbootShow2("CHAINBOOT LZ4", "BAD MAGIC");
+		ChainbootShow2("CHAINBOOT LZ4", "BAD SIZE");
 		f_close(&file);
-#if defined(PI1541_CHAINBOOT_HELPER)
-		HelperLogKV("lz4_magic_bad", t_open0, now_us(), magic, kLz4LegacyMagic);
-#endif
 		return -1;
 	}
 
-	const unsigned int fileSize = f_size(&file);
-	unsigned int inOffset = sizeof(magic);
+	// Word aligned for the EMMC driver's FIFO copies.
+	unsigned char* const in = dest + ((kMaxKernelSize - fileSize) & ~63u);
+	const unsigned int chunk = 256 * 1024;
+	unsigned int have = 0;		// stream bytes read into 'in'
+	unsigned int inOffset = 0;	// parse position in 'in'
 	unsigned int outOffset = 0;
 	unsigned int lastShown = 0;
+	int done = 0;
 #if defined(PI1541_CHAINBOOT_HELPER)
 	const unsigned t_stream0 = now_us();
 	unsigned read_us_acc = 0;
@@ -225,106 +242,121 @@ static int ReadKernelFileLz4Legacy(const char* kernelName, unsigned char* dest,
 	unsigned blocks = 0;
 #endif
 
-	while (1)
+	while (!done)
 	{
-		uint32_t blockSize = 0;
-		if (inOffset + sizeof(blockSize) > fileSize)
-			break; // legacy stream can end without a zero terminator
-		res = f_read(&file, &blockSize, sizeof(blockSize), &br);
-		if (res != FR_OK || br != sizeof(blockSize))
+		if (have < fileSize)
 		{
-			ChainbootShow2("CHAINBOOT LZ4", "READ ERR");
-			f_close(&file);
-			return -1;
-		}
-		inOffset += sizeof(blockSize);
-		if (blockSize == 0)
-			break;
-
-		const unsigned int uncompressed = (blockSize & 0x80000000u) != 0;
-		blockSize &= 0x7FFFFFFFu;
-		if (blockSize > (fileSize - inOffset))
-		{
-			ChainbootShow2("CHAINBOOT LZ4", "TRUNCATED");
-			f_close(&file);
-			return -1;
-		}
-		if (blockSize == 0 || blockSize > kMaxKernelSize)
-		{
-			ChainbootShow2("CHAINBOOT LZ4", "BAD SIZE");
-			f_close(&file);
-			return -1;
-		}
-
-		unsigned char* block = (unsigned char*)malloc(blockSize);
-		if (!block)
-		{
-			ChainbootShow2("CHAINBOOT LZ4", "NO MEM");
-			f_close(&file);
+			const unsigned int remaining = fileSize - have;
+			const unsigned int toRead = remaining < chunk ? remaining : chunk;
+			UINT br = 0;
 #if defined(PI1541_CHAINBOOT_HELPER)
-			HelperLogKV("lz4_nomem", t_stream0, now_us(), blockSize, 0);
+			const unsigned t_read0 = now_us();
 #endif
-			return -1;
-		}
-
+			res = f_read(&file, in + have, toRead, &br);
+			if (res != FR_OK || br != toRead)
+			{
+				ChainbootShow2("CHAINBOOT LZ4", "READ ERR");
+				f_close(&file);
 #if defined(PI1541_CHAINBOOT_HELPER)
-		const unsigned t_blk_read0 = now_us();
+				HelperLogKV("lz4_read_fail", t_read0, now_us(), (unsigned)res, toRead);
 #endif
-		res = f_read(&file, block, blockSize, &br);
-		if (res != FR_OK || br != blockSize)
-		{
-			free(block);
-			ChainbootShow2("CHAINBOOT LZ4", "READ ERR");
-			f_close(&file);
+				return -1;
+			}
 #if defined(PI1541_CHAINBOOT_HELPER)
-			HelperLogKV("lz4_read_fail", t_blk_read0, now_us(), (unsigned)res, blockSize);
+			read_us_acc += delta_us(t_read0, now_us());
 #endif
-			return -1;
+			have += br;
 		}
-#if defined(PI1541_CHAINBOOT_HELPER)
-		const unsigned t_blk_read1 = now_us();
-		read_us_acc += delta_us(t_blk_read0, t_blk_read1);
-		const unsigned t_blk_dec0 = now_us();
-#endif
-		inOffset += blockSize;
 
-		if (uncompressed)
+		if (inOffset == 0)
 		{
-			if (outOffset + blockSize > kMaxKernelSize)
+			const uint32_t magic = GetLE32(in);
+			if (magic != kLz4LegacyMagic)
 			{
-				free(block);
-				ChainbootShow2("CHAINBOOT LZ4", "TOO BIG");
+				ChainbootShow2("CHAINBOOT LZ4", "BAD MAGIC");
 				f_close(&file);
+#if defined(PI1541_CHAINBOOT_HELPER)
+				HelperLogKV("lz4_magic_bad", t_open0, now_us(), magic, kLz4LegacyMagic);
+#endif
 				return -1;
 			}
-			memcpy(dest + outOffset, block, blockSize);
-			outOffset += blockSize;
+			inOffset = sizeof(magic);
 		}
-		else
+
+		// Decompress every block that is complete in the buffer.
+		while (1)
 		{
-			const int dec = lz4_legacy_decompress_block(block, (int)blockSize,
-								    dest + outOffset,
-								    (int)(kMaxKernelSize - outOffset));
-			if (dec < 0)
+			if (inOffset + sizeof(uint32_t) > have)
 			{
-				free(block);
-				ChainbootShow2("CHAINBOOT LZ4", "DECOMP ERR");
+				if (have == fileSize)
+					done = 1; // legacy stream can end without a zero terminator
+				break;
+			}
+			uint32_t blockSize = GetLE32(in + inOffset);
+			if (blockSize == 0)
+			{
+				done = 1;
+				break;
+			}
+
+			const unsigned int uncompressed = (blockSize & 0x80000000u) != 0;
+			blockSize &= 0x7FFFFFFFu;
+			if (blockSize > (fileSize - inOffset - sizeof(uint32_t)))
+			{
+				ChainbootShow2("CHAINBOOT LZ4", "TRUNCATED");
 				f_close(&file);
 				return -1;
 			}
-			outOffset += (unsigned int)dec;
-		}
+			if (blockSize == 0)
+			{
+				ChainbootShow2("CHAINBOOT LZ4", "BAD SIZE");
+				f_close(&file);
+				return -1;
+			}
+			if (inOffset + sizeof(uint32_t) + blockSize > have)
+				break; // rest of the block is in the next chunk
+			inOffset += sizeof(uint32_t);
+
+#if defined(PI1541_CHAINBOOT_HELPER)
+			const unsigned t_blk_dec0 = now_us();
+#endif
+			const unsigned char* block = in + inOffset;
+			unsigned char* out = dest + outOffset;
+			const unsigned int blockEnd = (unsigned int)(in - dest) + inOffset + blockSize;
+			const unsigned int room = blockEnd > margin + outOffset ? blockEnd - margin - outOffset : 0;
+			if (uncompressed)
+			{
+				if (blockSize > room)
+				{
+					ChainbootShow2("CHAINBOOT LZ4", "TOO BIG");
+					f_close(&file);
+					return -1;
+				}
+				memmove(out, block, blockSize);
+				outOffset += blockSize;
+			}
+			else
+			{
+				const int dec = lz4_legacy_decompress_block(block, (int)blockSize, out, (int)room);
+				if (dec < 0)
+				{
+					ChainbootShow2("CHAINBOOT LZ4", "DECOMP ERR");
+					f_close(&file);
+					return -1;
+				}
+				outOffset += (unsigned int)dec;
+			}
+			inOffset += blockSize;
 #if defined(PI1541_CHAINBOOT_HELPER)
-		const unsigned t_blk_dec1 = now_us();
-		dec_us_acc += delta_us(t_blk_dec0, t_blk_dec1);
-		blocks++;
+			dec_us_acc += delta_us(t_blk_dec0, now_us());
+			blocks++;
 #endif
-		free(block);
+		}
 
-		if ((inOffset - lastShown) >= (256 * 1024) || inOffset >= fileSize)
+		if ((have - lastShown) >= (256 * 1024) || have >= fileSize)
 		{
-			lastShown = inOffset;
-			const unsigned int pct = fileSize ? (unsigned int)(((unsigned long long)inOffset * 100ULL) / (unsigned long long)fileSize) : 0;
+			lastShown = have;
+			const unsigned int pct = (unsigned int)(((unsigned long long)have * 100ULL) / (unsigned long long)fileSize);
 			snprintf(line0, sizeof(line0), "CHAINBOOT LZ4");
 			snprintf(line1, sizeof(line1), "%u%% %uK", pct, (unsigned int)((outOffset + 1023U) / 1024U));
 			ChainbootShow2(line0, line1);
@@ -347,6 +379,8 @@ static int ReadKernelFileLz4Legacy(const char* kernelName, unsigned char* dest,
 					    ? (unsigned)((unsigned long long)fileSize * 1000000ULL / read_us_acc)
 					    : 0;
 		HelperLogKV("lz4_read_rate", t_stream0, t_stream0, read_rate, fileSize);
+		BootTimelineMark(BOOT_PHASE_CHAIN_KERNEL_READ, read_us_acc);
+		BootTimelineMark(BOOT_PHASE_CHAIN_KERNEL_DECOMPRESS, dec_us_acc);
 	}
 #endif
 	*outSize = outOffset;
@@ -400,6 +434,9 @@ void ChainBootLegacy(const char* kernelName)
 #if defined(PI1541_CHAINBOOT_HELPER)
 	HelperLogKV("load_done", t_cb0, now_us(), fileSize, kServiceEntryAddr);
 #endif
+	// The service kernel continues this record.
+	BootTimelineMark(BOOT_PHASE_CHAIN_KERNEL_LOADED, fileSize);
+	BootTimelineSave();
 
 	// Make the new image visible to the CPU, then jump with a clean CPU state.
 	// Silent teardown+jump to avoid OLED flicker.
@@ -0,0 +1,66 @@
+// contiguous_file.cpp
+//
+// See contiguous_file.h.
+
+#include "contiguous_file.h"
+
+#if CONTIGUOUS_ENABLED
+
+static bool IsContiguous(FIL *file)
+{
+#if CONTIGUOUS_CHECK
+	// A link map of one fragment takes 4 words; more fragments do not fit.
+	DWORD table[4];
+	table[0] = 4;
+	file->cltbl = table;
+	const FRESULT res = f_lseek(file, CREATE_LINKMAP);
+	file->cltbl = 0;
+	return res == FR_OK;
+#else
+	return false;
+#endif
+}
+
+FRESULT ContiguousOpen(FIL *file, const TCHAR *path, FSIZE_t size)
+{
+	FRESULT res = f_open(file, path, FA_OPEN_ALWAYS | FA_WRITE);
+	if (res != FR_OK || size == 0)
+		return res;
+
+	if (f_size(file) >= size && IsContiguous(file))
+		return FR_OK;
+
+	if (f_size(file))
+	{
+		res = f_truncate(file);
+		if (res != FR_OK)
+		{
+			f_close(file);
+			return res;
+		}
+	}
+	// No contiguous block left: f_write() allocates as usual.
+	f_expand(file, size, 1);
+	return FR_OK;
+}
+
+FRESULT ContiguousClose(FIL *file)
+{
+	const FRESULT res = f_truncate(file);
+	const FRESULT closeRes = f_close(file);
+	return res != FR_OK ? res : closeRes;
+}
+
+#else
+
+FRESULT ContiguousOpen(FIL *file, const TCHAR *path, FSIZE_t size)
+{
+	return f_open(file, path, FA_CREATE_ALWAYS | FA_WRITE);
+}
+
+FRESULT ContiguousClose(FIL *file)
+{
+	return f_close(file);
+}
+
+#endif
@@ -0,0 +1,33 @@
+// contiguous_file.h
+//
+// Keeps files that are rewritten whole (D64/G64 write-back) in one contiguous
+// cluster run. FA_CREATE_ALWAYS frees the old chain and the writes allocate a
+// new one cluster by cluster from wherever the last allocation ended, so over
+// time images end up spread over the card, costing FAT sector reads and
+// splitting multi-block transfers.
+//
+// ContiguousOpen() rewrites an existing contiguous file in place, otherwise
+// it allocates a contiguous block of the final size with f_expand(); close
+// with ContiguousClose(), which cuts the file at the last write.
+//
+// Without f_expand() (FF_USE_EXPAND/_USE_EXPAND 0) files are opened with
+// FA_CREATE_ALWAYS and allocated as before.
+
+#ifndef CONTIGUOUS_FILE_H
+#define CONTIGUOUS_FILE_H
+
+#if defined(__CIRCLE__)
+#include <fatfs/ff.h>
+#define CONTIGUOUS_ENABLED FF_USE_EXPAND
+#define CONTIGUOUS_CHECK FF_USE_FASTSEEK
+#else
+#include "ff-local.h"
+#define CONTIGUOUS_ENABLED _USE_EXPAND
+#define CONTIGUOUS_CHECK _USE_FASTSEEK
+#endif
+
+// Opens path for writing size bytes from offset 0.
+FRESULT ContiguousOpen(FIL *file, const TCHAR *path, FSIZE_t size);
+FRESULT ContiguousClose(FIL *file);
+
+#endif
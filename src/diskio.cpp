@@ -9,6 +9,8 @@
 #include "diskio.h"		/* FatFs lower layer API */
 #include "debug.h"
 #include "rpiHardware.h"
+#include <string.h>
+#include <stdlib.h>
 
 #define SD_BLOCK_SIZE		512
 
@@ -27,6 +29,9 @@ extern "C"
 #define DEV_MMC		0	/* Example: Map MMC/SD card to physical drive 0 */
 #if !defined(PI1541_CHAINBOOT_HELPER)
 #define DEV_USB		1
+// One bulk transfer is limited by the DWHCI channel's 10 bit packet count;
+// f_read() now passes whole contiguous runs, so split them here.
+#define USB_MAX_READ_SECTORS	128
 #endif
 
 //static struct emmc_block_dev *emmc_dev;
@@ -131,6 +136,156 @@ size_t sd_write(uint8_t *buf, size_t buf_size, uint32_t block_no)
 #endif /* ESP32 */
 
 
+#if !defined(PI1541_CHAINBOOT_HELPER) && !defined(ESP32)
+/*-----------------------------------------------------------------------*/
+/* USB read cache                                                        */
+/*-----------------------------------------------------------------------*/
+
+// Every USB mass storage read is a synchronous SCSI command with a fixed
+// cost well above that of transferring a few sectors, and browsing a stick
+// (directory scans, FAT lookups, image headers) reads a sector at a time.
+// Reads shorter than the read-ahead are served from a few windows shared by
+// all devices; a miss fills a window with the read-ahead starting at the
+// missed sector, so sequential reads take one command per window. Longer
+// reads go straight to the device. Writes go through and update cached copies.
+#define USB_CACHE_WINDOWS	4
+
+struct USBCacheWindow
+{
+	BYTE *data;
+	DWORD sector;
+	UINT count;		// 0: empty
+	u32 used;
+	BYTE pdrv;
+};
+
+static USBCacheWindow usbCache[USB_CACHE_WINDOWS];
+static UINT usbReadAhead;
+static u32 usbCacheUseSeq;
+
+void disk_setUSBReadAhead(unsigned sectors)
+{
+	if (sectors > USB_MAX_READ_SECTORS)
+		sectors = USB_MAX_READ_SECTORS;
+
+	for (unsigned i = 0; i < USB_CACHE_WINDOWS; ++i)
+	{
+		free(usbCache[i].data);
+		usbCache[i].data = 0;
+		usbCache[i].count = 0;
+	}
+	usbReadAhead = 0;
+	if (sectors < 2)
+		return;
+
+	for (unsigned i = 0; i < USB_CACHE_WINDOWS; ++i)
+	{
+		usbCache[i].data = (BYTE *)malloc(sectors << UMSD_BLOCK_SHIFT);
+		if (!usbCache[i].data)
+			return;
+	}
+	usbReadAhead = sectors;
+}
+
+static void USBCacheInvalidate(BYTE pdrv)
+{
+	for (unsigned i = 0; i < USB_CACHE_WINDOWS; ++i)
+	{
+		if (usbCache[i].pdrv == pdrv)
+			usbCache[i].count = 0;
+	}
+}
+
+static DRESULT USBRead(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+	while (count)
+	{
+		UINT chunk = count < USB_MAX_READ_SECTORS ? count : USB_MAX_READ_SECTORS;
+		unsigned bytes = (unsigned)USPiMassStorageDeviceRead((unsigned long long)sector << UMSD_BLOCK_SHIFT, buff, chunk << UMSD_BLOCK_SHIFT, pdrv - 1);
+
+		if (bytes != (chunk << UMSD_BLOCK_SHIFT))
+			return RES_ERROR;
+
+		buff += chunk << UMSD_BLOCK_SHIFT;
+		sector += chunk;
+		count -= chunk;
+	}
+	return RES_OK;
+}
+
+static USBCacheWindow *USBCacheFill(BYTE pdrv, DWORD sector)
+{
+	USBCacheWindow *window = &usbCache[0];
+	for (unsigned i = 1; i < USB_CACHE_WINDOWS; ++i)
+	{
+		if (!window->count)
+			break;
+		if (!usbCache[i].count || (s32)(usbCache[i].used - window->used) < 0)
+			window = &usbCache[i];
+	}
+
+	// Stop at the end of the device, the last window would fail otherwise.
+	UINT count = usbReadAhead;
+	const unsigned capacity = USPiMassStorageDeviceGetCapacity(pdrv - 1);
+	if (capacity && sector + count > capacity)
+		count = capacity > sector ? capacity - sector : 0;
+
+	window->count = 0;
+	if (!count || USBRead(pdrv, window->data, sector, count) != RES_OK)
+		return 0;
+	window->pdrv = pdrv;
+	window->sector = sector;
+	window->count = count;
+	return window;
+}
+
+static DRESULT USBCacheRead(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+	while (count)
+	{
+		USBCacheWindow *window = 0;
+		for (unsigned i = 0; i < USB_CACHE_WINDOWS; ++i)
+		{
+			if (usbCache[i].count && usbCache[i].pdrv == pdrv && sector - usbCache[i].sector < usbCache[i].count)
+			{
+				window = &usbCache[i];
+				break;
+			}
+		}
+		if (!window)
+			window = USBCacheFill(pdrv, sector);
+		if (!window)
+			return USBRead(pdrv, buff, sector, count);
+
+		const UINT offset = sector - window->sector;
+		const UINT n = window->count - offset < count ? window->count - offset : count;
+		memcpy(buff, window->data + (offset << UMSD_BLOCK_SHIFT), n << UMSD_BLOCK_SHIFT);
+		window->used = ++usbCacheUseSeq;
+		buff += n << UMSD_BLOCK_SHIFT;
+		sector += n;
+		count -= n;
+	}
+	return RES_OK;
+}
+
+static void USBCacheWrite(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+	for (unsigned i = 0; i < USB_CACHE_WINDOWS; ++i)
+	{
+		USBCacheWindow *window = &usbCache[i];
+		if (!window->count || window->pdrv != pdrv)
+			continue;
+
+		const DWORD start = sector > window->sector ? sector : window->sector;
+		const DWORD end = sector + count < window->sector + window->count ? sector + count : window->sector + window->count;
+		if (start < end)
+			memcpy(window->data + ((start - window->sector) << UMSD_BLOCK_SHIFT), buff + ((start - sector) << UMSD_BLOCK_SHIFT), (end - start) << UMSD_BLOCK_SHIFT);
+	}
+}
+#endif
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -198,6 +353,13 @@ DSTATUS disk_initialize (
 
 		break;
 
+#if !defined(PI1541_CHAINBOOT_HELPER)
+	default :
+		// A device may have been replaced since the last mount.
+		USBCacheInvalidate(pdrv);
+		break;
+#endif
+
 	////case DEV_USB :
 	////	result = USB_disk_initialize();
 
@@ -212,6 +374,130 @@ DSTATUS disk_initialize (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* SD sector cache                                                       */
+/*-----------------------------------------------------------------------*/
+
+// Single-sector writes to the SD card (FAT, directory and FSInfo sectors,
+// FatFs' per-file sector buffer) are kept here until FatFs calls CTRL_SYNC:
+// f_sync(), f_close(), f_unlink(), f_rename(), f_mkdir(), f_chmod(),
+// f_utime() and f_setlabel(). A sector rewritten between syncs, like the FAT
+// sector of a growing chain or a directory sector revisited after a window
+// change, then reaches the card once, and tmp write -> f_sync -> unlink ->
+// rename still reaches the card in that order.
+//
+// f_open() (also when it creates the file), f_write(), f_truncate(),
+// f_expand() and f_lseek() growth do not sync. While a file stays open, as an
+// IEC save channel does, its new directory entry, the FAT sectors of its new
+// clusters and its last partial data sector can stay in RAM until f_sync() or
+// f_close(); without the cache some of them reached the card whenever FatFs
+// moved its window. Power loss in that window loses them. What FatFs left on
+// the card is no less consistent for it: the file's size and first cluster
+// in its directory entry are only written on sync anyway, so the card keeps
+// the file as of its last sync (or no file), with the new clusters still
+// free rather than allocated but unreferenced. Only the 16-entry limit below
+// writes earlier.
+//
+// Dirty sectors are flushed in the order of their last write: a sector goes
+// out after everything it was last written after, as FatFs wrote them.
+// Multi-sector writes (file data) go straight to the card and replace any
+// cached copy. Clean sectors stay cached and serve re-reads.
+#define SECTOR_CACHE_ENTRIES	16
+
+struct SectorCacheEntry
+{
+	BYTE data[SD_BLOCK_SIZE];
+	DWORD sector;
+	u32 written;	// write sequence, orders the flush
+	u32 used;		// for LRU replacement
+	u8 valid;
+	u8 dirty;
+} __attribute__((aligned(64)));
+
+static SectorCacheEntry sectorCache[SECTOR_CACHE_ENTRIES];
+static u32 sectorCacheWriteSeq;
+static u32 sectorCacheUseSeq;
+
+static SectorCacheEntry *SectorCacheFind(DWORD sector)
+{
+	for (unsigned i = 0; i < SECTOR_CACHE_ENTRIES; ++i)
+	{
+		if (sectorCache[i].valid && sectorCache[i].sector == sector)
+			return &sectorCache[i];
+	}
+	return 0;
+}
+
+static DRESULT SectorCacheFlush(void)
+{
+	for (;;)
+	{
+		SectorCacheEntry *next = 0;
+		for (unsigned i = 0; i < SECTOR_CACHE_ENTRIES; ++i)
+		{
+			SectorCacheEntry *entry = &sectorCache[i];
+			if (entry->valid && entry->dirty && (!next || (s32)(entry->written - next->written) < 0))
+				next = entry;
+		}
+		if (!next)
+			return RES_OK;
+
+		if (sd_write(next->data, SD_BLOCK_SIZE, next->sector) != SD_BLOCK_SIZE)
+			return RES_ERROR;
+		next->dirty = 0;
+	}
+}
+
+// A free or least recently used clean entry; flushes first if all are dirty.
+static SectorCacheEntry *SectorCacheAllocate(void)
+{
+	SectorCacheEntry *victim = 0;
+	for (unsigned i = 0; i < SECTOR_CACHE_ENTRIES; ++i)
+	{
+		SectorCacheEntry *entry = &sectorCache[i];
+		if (!entry->valid)
+			return entry;
+		if (!entry->dirty && (!victim || (s32)(entry->used - victim->used) < 0))
+			victim = entry;
+	}
+	if (victim)
+		return victim;
+
+	if (SectorCacheFlush() != RES_OK)
+		return 0;
+	victim = &sectorCache[0];
+	for (unsigned i = 1; i < SECTOR_CACHE_ENTRIES; ++i)
+	{
+		if ((s32)(sectorCache[i].used - victim->used) < 0)
+			victim = &sectorCache[i];
+	}
+	return victim;
+}
+
+static bool SectorCacheFill(DWORD sector, const BYTE *data, bool dirty)
+{
+	SectorCacheEntry *entry = SectorCacheFind(sector);
+	if (!entry)
+	{
+		entry = SectorCacheAllocate();
+		if (!entry)
+			return false;
+		entry->valid = 1;
+		entry->dirty = 0;
+		entry->sector = sector;
+	}
+	memcpy(entry->data, data, SD_BLOCK_SIZE);
+	entry->used = ++sectorCacheUseSeq;
+	if (dirty)
+	{
+		entry->dirty = 1;
+		entry->written = ++sectorCacheWriteSeq;
+	}
+	return true;
+}
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
@@ -226,21 +512,44 @@ DRESULT disk_read (
 	//DEBUG_LOG("r pdrv = %d\r\n", pdrv);
 	if (pdrv == 0)
 	{
+		if (count == 1)
+		{
+			SectorCacheEntry *entry = SectorCacheFind(sector);
+			if (entry)
+			{
+				memcpy(buff, entry->data, SD_BLOCK_SIZE);
+				entry->used = ++sectorCacheUseSeq;
+				return RES_OK;
+			}
+		}
+
 		if (sd_read(buff, count * SD_BLOCK_SIZE, sector) < (count * SD_BLOCK_SIZE))
 		{
 			return RES_ERROR;
 		}
+
+		if (count == 1)
+		{
+			SectorCacheFill(sector, buff, false);
+		}
+		else
+		{
+			// The card is behind for sectors not flushed yet.
+			for (unsigned i = 0; i < SECTOR_CACHE_ENTRIES; ++i)
+			{
+				SectorCacheEntry *entry = &sectorCache[i];
+				if (entry->valid && entry->dirty && entry->sector - sector < count)
+					memcpy(buff + (entry->sector - sector) * SD_BLOCK_SIZE, entry->data, SD_BLOCK_SIZE);
+			}
+		}
 		return RES_OK;
 	}
 #if !defined(PI1541_CHAINBOOT_HELPER) && !defined(ESP32)
 	else
 	{
-		unsigned bytes = (unsigned)USPiMassStorageDeviceRead((unsigned long long )(sector << UMSD_BLOCK_SHIFT), buff, count << UMSD_BLOCK_SHIFT, pdrv - 1);
-
-		if (bytes != (count << UMSD_BLOCK_SHIFT))
-			return RES_ERROR;
-
-		return RES_OK;
+		if (count < usbReadAhead)
+			return USBCacheRead(pdrv, buff, sector, count);
+		return USBRead(pdrv, buff, sector, count);
 	}
 #endif	
 
@@ -263,6 +572,11 @@ DRESULT disk_write (
 	//DEBUG_LOG("w pdrv = %d\r\n", pdrv);
 	if (pdrv == 0)
 	{
+		if (count == 1)
+		{
+			return SectorCacheFill(sector, buff, true) ? RES_OK : RES_ERROR;
+		}
+
 		for (UINT s = 0; s < count; ++s)
 		{
 			if (sd_write((uint8_t *)buff, SD_BLOCK_SIZE, sector+s) < SD_BLOCK_SIZE)
@@ -271,6 +585,11 @@ DRESULT disk_write (
 			}
 			buff += SD_BLOCK_SIZE;
 		}
+		for (unsigned i = 0; i < SECTOR_CACHE_ENTRIES; ++i)
+		{
+			if (sectorCache[i].valid && sectorCache[i].sector - sector < count)
+				sectorCache[i].valid = 0;
+		}
 		return RES_OK;
 	}
 #if !defined(PI1541_CHAINBOOT_HELPER) && !defined(ESP32)
@@ -280,8 +599,12 @@ DRESULT disk_write (
 
 		//DEBUG_LOG("USB disk_write %d %d\r\n", (int)sector, (int)count);
 		if (bytes != (count << UMSD_BLOCK_SHIFT))
+		{
+			USBCacheInvalidate(pdrv);
 			return RES_ERROR;
+		}
 
+		USBCacheWrite(pdrv, buff, sector, count);
 		return RES_OK;
 	}
 #endif
@@ -302,11 +625,11 @@ DRESULT disk_ioctl (
 {
 	(void) buff;
 
-	// FatFs uses CTRL_SYNC from f_sync()/f_close() paths. Our SD writes are
-	// synchronous at the block layer, so CTRL_SYNC is a no-op that succeeds.
+	// FatFs uses CTRL_SYNC from f_sync()/f_close() and the name-level calls
+	// (see the sector cache above): write out the sector cache.
 	if (pdrv == DEV_MMC && cmd == CTRL_SYNC)
 	{
-		return RES_OK;
+		return SectorCacheFlush();
 	}
 
 	return RES_PARERR;
@@ -36,6 +36,7 @@ typedef enum {
 #if !defined(ESP32)
 void disk_setEMM(CEMMCDevice* pEMMCDevice);
 void disk_setUSB(unsigned deviceIndex);
+void disk_setUSBReadAhead(unsigned sectors);
 #endif
 
 DSTATUS disk_initialize (BYTE pdrv);
@@ -0,0 +1,153 @@
+// emu_snapshot.cpp
+//
+// See emu_snapshot.h.
+
+#include "emu_snapshot.h"
+#include "Pi1541.h"
+#include "debug.h"
+#include "ff-local.h"
+
+#include <string.h>
+
+extern "C"
+{
+extern u32 __executable_start[];
+extern u32 _etext[];
+}
+
+struct EmuSnapshotHeader
+{
+	u32 magic;
+	u16 version;
+	u16 reserved;
+	u32 kernelHash;		// code the chip state's code pointers refer to
+	u32 stateSize;
+	u32 ramSize;
+	u32 activeSetHash;
+	u32 caddyIndex;
+	u32 dataHash;		// state + RAM
+};
+
+// Header, chip state and at most the full 48 KB of extra RAM / RAMBoard.
+static u8 s_snapshot[sizeof(EmuSnapshotHeader) + 1024 + 0xc000] __attribute__((aligned(8)));
+static bool s_loaded = false;
+
+static u32 HashWords(u32 hash, const u32* words, unsigned count)
+{
+	while (count--)
+	{
+		hash ^= *words++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static u32 KernelHash(void)
+{
+	return HashWords(0x811c9dc5U, __executable_start, (unsigned)(_etext - __executable_start));
+}
+
+static u8* StateData(void)
+{
+	return s_snapshot + ((sizeof(EmuSnapshotHeader) + 7) & ~7u);
+}
+
+static unsigned DataSize(const EmuSnapshotHeader* header)
+{
+	return header->stateSize + header->ramSize;
+}
+
+bool EmuSnapshotSave(const Pi1541& pi1541, const u8* ram, unsigned ramSize, u32 activeSetHash, u32 caddyIndex)
+{
+	EmuSnapshotHeader* header = (EmuSnapshotHeader*)s_snapshot;
+	const unsigned stateSize = (Pi1541::StateSize() + 3) & ~3u;
+	u8* data = StateData();
+	if (data + stateSize + ramSize > s_snapshot + sizeof(s_snapshot))
+		return false;
+
+	s_loaded = false;
+	memset(s_snapshot, 0, sizeof(s_snapshot));
+	pi1541.SaveState(data);
+	memcpy(data + stateSize, ram, ramSize);
+
+	header->magic = EMU_SNAPSHOT_MAGIC;
+	header->version = EMU_SNAPSHOT_VERSION;
+	header->kernelHash = KernelHash();
+	header->stateSize = stateSize;
+	header->ramSize = ramSize;
+	header->activeSetHash = activeSetHash;
+	header->caddyIndex = caddyIndex;
+	header->dataHash = HashWords(0x811c9dc5U, (const u32*)data, DataSize(header) / 4);
+
+	const UINT size = (UINT)(data - s_snapshot) + DataSize(header);
+	FIL file;
+	if (f_open(&file, EMU_SNAPSHOT_PATH, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return false;
+	UINT bw = 0;
+	const FRESULT res = f_write(&file, s_snapshot, size, &bw);
+	f_close(&file);
+	if (res != FR_OK || bw != size)
+	{
+		f_unlink(EMU_SNAPSHOT_PATH);
+		return false;
+	}
+	return true;
+}
+
+bool EmuSnapshotLoad(unsigned ramSize, u32 activeSetHash, u32* caddyIndex)
+{
+	s_loaded = false;
+
+	FIL file;
+	if (f_open(&file, EMU_SNAPSHOT_PATH, FA_READ) != FR_OK)
+		return false;
+	UINT br = 0;
+	const FRESULT res = f_read(&file, s_snapshot, sizeof(s_snapshot), &br);
+	f_close(&file);
+	f_unlink(EMU_SNAPSHOT_PATH);
+
+	const EmuSnapshotHeader* header = (const EmuSnapshotHeader*)s_snapshot;
+	const u8* data = StateData();
+	if (res != FR_OK || br < sizeof(EmuSnapshotHeader) || header->magic != EMU_SNAPSHOT_MAGIC ||
+	    header->version != EMU_SNAPSHOT_VERSION)
+		return false;
+	if (header->stateSize != ((Pi1541::StateSize() + 3) & ~3u) || header->ramSize != ramSize ||
+	    br != (UINT)(data - s_snapshot) + DataSize(header))
+	{
+		DEBUG_LOG("%s: size mismatch\r\n", __FUNCTION__);
+		return false;
+	}
+	if (header->activeSetHash != activeSetHash)
+	{
+		DEBUG_LOG("%s: active set changed\r\n", __FUNCTION__);
+		return false;
+	}
+	if (header->kernelHash != KernelHash() ||
+	    header->dataHash != HashWords(0x811c9dc5U, (const u32*)data, DataSize(header) / 4))
+	{
+		DEBUG_LOG("%s: foreign or damaged snapshot\r\n", __FUNCTION__);
+		return false;
+	}
+
+	*caddyIndex = header->caddyIndex;
+	s_loaded = true;
+	return true;
+}
+
+bool EmuSnapshotApply(Pi1541& pi1541, u8* ram)
+{
+	if (!s_loaded)
+		return false;
+	s_loaded = false;
+
+	const EmuSnapshotHeader* header = (const EmuSnapshotHeader*)s_snapshot;
+	const u8* data = StateData();
+	pi1541.LoadState(data);
+	memcpy(ram, data + header->stateSize, header->ramSize);
+	return true;
+}
+
+void EmuSnapshotDiscard(void)
+{
+	s_loaded = false;
+}
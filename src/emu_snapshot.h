@@ -0,0 +1,36 @@
+// emu_snapshot.h
+//
+// Emulated 1541 state kept across a service round trip. Entering MINI SERVICE
+// chainloads another kernel, so without it the emulator comes back with a
+// cold drive: ROM self test (FAST_BOOT_CYCLES), head on track 19, drive RAM
+// and VIA state of a running fast loader lost.
+//
+// On EXIT_SERVICE the emulator saves the CPU, VIAs, drive mechanics, drive
+// RAM and caddy selection (after the caddy wrote dirty images back) to
+// EMU_SNAPSHOT_PATH. At the next boot MountActiveSet() loads it if it came
+// from this kernel binary and the active set (ACTIVE.LST, image sizes and
+// dates, ROM) is unchanged, and Emulate1541() applies it in place of the
+// fast boot. A snapshot is used at most once: loading deletes the file, and
+// committing a new set in the service clears _active_mount/ anyway.
+
+#ifndef EMU_SNAPSHOT_H
+#define EMU_SNAPSHOT_H
+
+#include "types.h"
+
+class Pi1541;
+
+#define EMU_SNAPSHOT_PATH "SD:/1541/_active_mount/emustate.bin"
+#define EMU_SNAPSHOT_MAGIC 0x53553150u	// "P1US"
+#define EMU_SNAPSHOT_VERSION 1
+
+bool EmuSnapshotSave(const Pi1541& pi1541, const u8* ram, unsigned ramSize, u32 activeSetHash, u32 caddyIndex);
+
+// Reads and deletes the snapshot; true if it can be applied to this set.
+bool EmuSnapshotLoad(unsigned ramSize, u32 activeSetHash, u32* caddyIndex);
+
+// Restores a loaded snapshot into the chips and RAM, once; false if none.
+bool EmuSnapshotApply(Pi1541& pi1541, u8* ram);
+void EmuSnapshotDiscard(void);
+
+#endif
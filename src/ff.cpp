@@ -3493,6 +3493,21 @@ FRESULT f_read (
 			if (cc) {							/* Read maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
+#if _FS_READ_COALESCE
+					while (cc < btr / SS(fs) && cc + fs->csize <= _FS_READ_COALESCE) {	/* Extend over following contiguous clusters */
+#if _USE_FASTSEEK
+						if (fp->cltbl) {
+							clst = clmt_clust(fp, fp->fptr + (FSIZE_t)cc * SS(fs));
+						} else
+#endif
+						{
+							clst = get_fat(&fp->obj, fp->clust);
+						}
+						if (clst != fp->clust + 1) break;	/* Fragmented, end of chain or error: leave it to the next round */
+						fp->clust = clst;
+						cc += (btr / SS(fs) - cc < fs->csize) ? btr / SS(fs) - cc : fs->csize;
+					}
+#endif
 				}
 				if (disk_read(fs->drv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2			/* Replace one of the read sectors with cached data if it contains a dirty sector */
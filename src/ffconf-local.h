@@ -43,11 +43,11 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
-#define	_USE_FASTSEEK	0
+#define	_USE_FASTSEEK	1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define	_USE_EXPAND		0
+#define	_USE_EXPAND		1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
@@ -210,6 +210,14 @@
 /  buffer in the file system object (FATFS) is used for the file data transfer. */
 
 
+#define _FS_READ_COALESCE	0xFFFF
+/* This option sets the maximum number of sectors f_read() passes to a single
+/  disk_read(). Direct reads continue across clusters that follow each other on
+/  the volume (FAT chain or CLMT), so a contiguous file is read with one
+/  multi-block command instead of one per cluster. 0xFFFF is the block count
+/  limit of the EMMC controller. (0:Read at most one cluster per disk_read()) */
+
+
 #define _FS_EXFAT	1
 /* This option switches support of exFAT file system. (0:Disable or 1:Enable)
 /  When enable exFAT, also LFN needs to be enabled. (_USE_LFN >= 1)
@@ -2078,27 +2078,8 @@ void IEC_Commands::AddDirectoryEntry(Channel& channel, const char* name, u16 blo
 	channel.cursor += dirEntryLength;
 }
 
-struct greater
-{
-	bool operator()(const FileBrowser::BrowsableList::Entry& lhs, const FileBrowser::BrowsableList::Entry& rhs) const
-	{
-		if (strcasecmp(lhs.filImage.fname, "..") == 0)
-			return true;
-		else if (strcasecmp(rhs.filImage.fname, "..") == 0)
-			return false;
-		else if (((lhs.filImage.fattrib & AM_DIR) && (rhs.filImage.fattrib & AM_DIR)) || (!(lhs.filImage.fattrib & AM_DIR) && !(rhs.filImage.fattrib & AM_DIR)))
-			return strcasecmp(lhs.filImage.fname, rhs.filImage.fname) < 0;
-		else if ((lhs.filImage.fattrib & AM_DIR) && !(rhs.filImage.fattrib & AM_DIR))
-			return true;
-		else
-			return false;
-	}
-};
-
 void IEC_Commands::LoadDirectory()
 {
-	DIR dir;
-	char* ext;
 	FRESULT res;
 
 	Channel& channel = channels[0];
@@ -2108,7 +2089,6 @@ void IEC_Commands::LoadDirectory()
 
 	DEBUG_LOG("$\r\n");
 
-	FileBrowser::BrowsableList::Entry entry;
 	std::vector<FileBrowser::BrowsableList::Entry> entries;
 	if (displayingDevices)
 	{
@@ -2116,22 +2096,7 @@ void IEC_Commands::LoadDirectory()
 	}
 	else
 	{
-		res = f_opendir(&dir, ".");
-printf("%s: opendir: %d\n", __FUNCTION__, res);		
-		if (res == FR_OK)
-		{
-			do
-			{
-				res = f_readdir(&dir, &entry.filImage);
-printf("%s: readdir: %d\n", __FUNCTION__, res);		
-				ext = strrchr(entry.filImage.fname, '.');
-				if (res == FR_OK && entry.filImage.fname[0] != 0 && !(ext && strcasecmp(ext, ".png") == 0) && (entry.filImage.fname[0] != '.'))
-					entries.push_back(entry);
-			} while (res == FR_OK && entry.filImage.fname[0] != 0);
-			f_closedir(&dir);
-
-			std::sort(entries.begin(), entries.end(), greater());
-		}
+		FileBrowser::ReadFolderEntries(entries);
 	}
 printf("%s: 1\n", __FUNCTION__);
 
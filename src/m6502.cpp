@@ -331,6 +331,16 @@ void M6502::Step(void)
 #endif //  SUPPORT_RDY_HALTING
 }
 
+void M6502::LoadState(const M6502& saved)
+{
+	DataBusReadFn busRead = dataBusReadFn;
+	DataBusWriteFn busWrite = dataBusWriteFn;
+
+	*this = saved;
+	dataBusReadFn = busRead;
+	dataBusWriteFn = busWrite;
+}
+
 void M6502::Reset(void)
 {
 	CLIMaskingInterrupt = false;
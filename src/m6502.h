@@ -509,6 +509,9 @@ public:
 	M6502(void* data, DataBusReadFn dataBusReadFn, DataBusWriteFn dataBusWriteFn) { SetBusFunctions(dataBusReadFn, dataBusWriteFn); }
 	void SetBusFunctions(DataBusReadFn dataBusReadFn, DataBusWriteFn dataBusWriteFn) {this->dataBusReadFn = dataBusReadFn; this->dataBusWriteFn = dataBusWriteFn; status = FLAG_CONSTANT; Reset(); }
 	void Reset(void);
+	// Takes the registers and cycle position of a CPU saved by the same kernel
+	// (addressModeCycleFn is a code pointer); keeps the bus functions.
+	void LoadState(const M6502& saved);
 	void Step(void);
 #ifdef  SUPPORT_RDY_HALTING
 	void RDY(bool asserted);
@@ -27,6 +27,20 @@ m6522::m6522()
 	Reset();
 }
 
+void m6522::LoadState(const m6522& saved)
+{
+	Interrupt* connectedIRQ = irq;
+	IOPort connectedPortA = portA;
+	IOPort connectedPortB = portB;
+
+	*this = saved;
+	irq = connectedIRQ;
+	connectedPortA.LoadState(saved.portA);
+	connectedPortB.LoadState(saved.portB);
+	portA = connectedPortA;
+	portB = connectedPortB;
+}
+
 void m6522::Reset()
 {
 	functionControlRegister = 0;
@@ -200,6 +200,9 @@ FCR/PCR
 
 	void Reset();
 	void ConnectIRQ(Interrupt* irq) { this->irq = irq; }
+	// Takes the registers and timers of a VIA saved by the same kernel; keeps
+	// the IRQ and port connections.
+	void LoadState(const m6522& saved);
 
 	inline IOPort* GetPortA() { return &portA; }
 	inline bool GetLatchPortA() const { return latchPortA; }
@@ -74,6 +74,12 @@ extern "C"
 
 #if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
 #include "chainboot_helper_stub.h"
+#include "boot_timeline.h"
+#include "emu_snapshot.h"
+// Boot phases are recorded for the service kernel's GET /boottime.
+#define BOOT_MARK(...) BootTimelineMark(__VA_ARGS__)
+#else
+#define BOOT_MARK(...) ((void)0)
 #endif
 
 // Pi Zero W (01W) netservice variant: HDMI splash asset (PNG) is only needed when STBI-based splash is enabled.
@@ -197,29 +203,18 @@ static bool IsActiveListEmpty(void)
 	return true;
 }
 static const unsigned kActiveMaxImages = 16;
-static FILINFO* g_activeFileInfos[kActiveMaxImages];
+// DiskImage/DiskCaddy retain FILINFO*; static storage keeps pointers valid.
+static FILINFO g_activeFileInfos[kActiveMaxImages];
 static unsigned g_activeFileInfoCount = 0;
+static u32 g_activeListHash = 0;
 
 // Active set contract: service kernel writes /1541/_active_mount/ACTIVE.LST (+ files).
 // Emulator reads it once at cold boot to auto-enter emulation.
 static void ClearActiveFileInfos(void)
 {
-	for (unsigned i = 0; i < g_activeFileInfoCount; ++i)
-		delete g_activeFileInfos[i];
 	g_activeFileInfoCount = 0;
 }
 
-static FILINFO* CopyActiveFileInfo(const FILINFO* src)
-{
-	// DiskImage/DiskCaddy retain FILINFO*; heap-copy to keep pointers valid.
-	if (g_activeFileInfoCount >= kActiveMaxImages || !src)
-		return 0;
-	FILINFO* copy = new FILINFO;
-	memcpy(copy, src, sizeof(*copy));
-	g_activeFileInfos[g_activeFileInfoCount++] = copy;
-	return copy;
-}
-
 #if defined(__CIRCLE__)
 // Circle has its own spinlock primitive; don't mix it with the legacy SpinLock.
 CSpinLock core0RefreshingScreen;
@@ -872,9 +867,11 @@ u32 HashBuffer(const void* pBuffer, u32 length)
 	return hash;
 }
 
-EmulatingMode BeginEmulating(FileBrowser* fileBrowser, const char* filenameForIcon)
+EmulatingMode BeginEmulating(FileBrowser* fileBrowser, const char* filenameForIcon, unsigned imageIndex = 0)
 {
 	DiskImage* diskImage = diskCaddy.SelectFirstImage();
+	if (imageIndex && imageIndex < diskCaddy.GetNumberOfImages())
+		diskImage = diskCaddy.SelectImage(imageIndex);
 	DEBUG_LOG("%s: name = %s, IconName='%s'\n", __FUNCTION__, diskImage->GetName(), filenameForIcon);
 	if (diskImage)
 	{
@@ -899,6 +896,39 @@ EmulatingMode BeginEmulating(FileBrowser* fileBrowser, const char* filenameForIc
 	return IEC_COMMANDS;
 }
 
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+// Identifies the active set a service snapshot belongs to: ACTIVE.LST, the
+// size and date of each listed image and the selected drive ROM. restat reads
+// the images' directory entries again (after the caddy wrote them back).
+static u32 ActiveSetHash(bool restat)
+{
+	u32 hash = g_activeListHash;
+	for (unsigned i = 0; i < g_activeFileInfoCount; ++i)
+	{
+		FILINFO fi = g_activeFileInfos[i];
+		if (restat && fi.fname[0])
+		{
+			// Images outside the mount dir fail here and just void the snapshot.
+			char path[320];
+			snprintf(path, sizeof(path), "%s/%s", kActiveMountDir, fi.fname);
+			if (f_stat(path, &fi) != FR_OK)
+				memset(&fi, 0, sizeof(fi));
+		}
+		const u32 values[3] = { (u32)fi.fsize, (u32)fi.fdate, (u32)fi.ftime };
+		hash = (hash ^ HashBuffer(values, sizeof(values))) * 16777619U;
+	}
+	for (u32 address = 0xc000; address <= 0xffff; ++address)
+		hash = (hash ^ roms.Read((u16)address)) * 16777619U;
+	return hash;
+}
+
+// Drive RAM kept in a snapshot: 2 KB, or all of it with extra RAM / RAMBoard.
+static unsigned SnapshotRAMSize(void)
+{
+	return (options.GetExtraRAM() || options.GetRAMBOard()) ? sizeof(s_u8Memory) : 0x800;
+}
+#endif
+
 static bool LoadActiveSetFromList(char* firstImageName, size_t firstImageNameLen)
 {
 	static char listBuffer[4096];
@@ -932,6 +962,15 @@ static bool LoadActiveSetFromList(char* firstImageName, size_t firstImageNameLen
 		return false;
 	}
 	listBuffer[bytesRead] = '\0';
+	g_activeListHash = HashBuffer(listBuffer, bytesRead);
+	BOOT_MARK(BOOT_PHASE_EMU_ACTIVE_LIST, bytesRead);
+
+	// Collect the image names first, then resolve them all in one scan of
+	// the directory instead of a lookup per name.
+	const char* names[kActiveMaxImages];
+	bool found[kActiveMaxImages];
+	unsigned count = 0;
+	unsigned missing = 0;
 
 	TextParser parser;
 	parser.SetData(listBuffer);
@@ -949,25 +988,61 @@ static bool LoadActiveSetFromList(char* firstImageName, size_t firstImageNameLen
 		if (diskType == DiskImage::LST)
 			continue;
 
-		FILINFO fi;
-		memset(&fi, 0, sizeof(fi));
-		res = f_stat(token, &fi);
-		if (res != FR_OK)
+		if (count >= kActiveMaxImages)
 		{
-			DEBUG_LOG("%s: missing image '%s' (%d)\r\n", __FUNCTION__, token, (int)res);
-			continue;
+			DEBUG_LOG("%s: active set full (%u)\r\n", __FUNCTION__, count);
+			break;
 		}
-		strncpy(fi.fname, token, sizeof(fi.fname) - 1);
-		fi.fname[sizeof(fi.fname) - 1] = '\0';
+		memset(&g_activeFileInfos[count], 0, sizeof(FILINFO));
+		names[count] = token;
+		found[count] = false;
+		if (!strchr(token, '/') && !strchr(token, ':'))
+			missing++;
+		count++;
+	}
 
-		bool readOnly = (fi.fattrib & AM_RDO) != 0;
-		FILINFO* copy = CopyActiveFileInfo(&fi);
-		if (!copy)
+	DIR dir;
+	if (missing && f_opendir(&dir, kActiveMountDir) == FR_OK)
+	{
+		FILINFO entry;
+		while (missing && f_readdir(&dir, &entry) == FR_OK && entry.fname[0])
 		{
-			DEBUG_LOG("%s: active set full (%u)\r\n", __FUNCTION__, g_activeFileInfoCount);
-			break;
+			if (entry.fattrib & AM_DIR)
+				continue;
+			for (unsigned i = 0; i < count; ++i)
+			{
+				if (!found[i] && strcasecmp(entry.fname, names[i]) == 0)
+				{
+					memcpy(&g_activeFileInfos[i], &entry, sizeof(entry));
+					found[i] = true;
+					missing--;
+				}
+			}
 		}
-		if (diskCaddy.Insert(copy, readOnly))
+		f_closedir(&dir);
+	}
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		FILINFO* fi = &g_activeFileInfos[i];
+		const char* token = names[i];
+
+		// Paths, and names the scan did not match byte for byte (non-ASCII
+		// case), take the usual lookup.
+		if (!found[i])
+		{
+			res = f_stat(token, fi);
+			if (res != FR_OK)
+			{
+				DEBUG_LOG("%s: missing image '%s' (%d)\r\n", __FUNCTION__, token, (int)res);
+				continue;
+			}
+			strncpy(fi->fname, token, sizeof(fi->fname) - 1);
+			fi->fname[sizeof(fi->fname) - 1] = '\0';
+		}
+
+		bool readOnly = (fi->fattrib & AM_RDO) != 0;
+		if (diskCaddy.Insert(fi, readOnly))
 		{
 			if (!anyMounted && firstImageNameLen)
 			{
@@ -976,13 +1051,9 @@ static bool LoadActiveSetFromList(char* firstImageName, size_t firstImageNameLen
 			}
 			anyMounted = true;
 		}
-		else
-		{
-			delete copy;
-			g_activeFileInfoCount--;
-			g_activeFileInfos[g_activeFileInfoCount] = 0;
-		}
 	}
+	g_activeFileInfoCount = count;
+	BOOT_MARK(BOOT_PHASE_EMU_CADDY_INSERT, diskCaddy.GetNumberOfImages());
 
 	return anyMounted;
 }
@@ -999,8 +1070,24 @@ static EmulatingMode MountActiveSet(FileBrowser* fileBrowser)
 	if (!LoadActiveSetFromList(firstImageName, sizeof(firstImageName)))
 		return IEC_COMMANDS;
 
+	u32 imageIndex = 0;
+	const char* iconName = firstImageName;
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+	if (EmuSnapshotLoad(SnapshotRAMSize(), ActiveSetHash(false), &imageIndex))
+	{
+		DEBUG_LOG("%s: resuming from service snapshot (image %u)\r\n", __FUNCTION__, (unsigned)imageIndex);
+		if (imageIndex < diskCaddy.GetNumberOfImages())
+			iconName = diskCaddy.GetImage(imageIndex)->GetName();
+	}
+#endif
+
 	inputMappings->Reset();
-	return BeginEmulating(fileBrowser, firstImageName[0] ? firstImageName : "");
+	EmulatingMode mode = BeginEmulating(fileBrowser, iconName && iconName[0] ? iconName : "", imageIndex);
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+	if (mode != EMULATING_1541)
+		EmuSnapshotDiscard();
+#endif
+	return mode;
 }
 #if !defined (__CIRCLE__)
 #if not defined(EXPERIMENTALZERO)
@@ -1034,7 +1121,7 @@ static void PlaySoundDMA(bool play)
 	if (play != 0) 
 		return;
 	write32(PWM_DMAC, PWM_ENAB + 0x0001);
-	write32(DMA_ENABLE, 1);	// DMA_EN0
+	write32(DMA_ENABLE, read32(DMA_ENABLE) | 1);	// DMA_EN0, keep the other channels
 	write32(DMA0_BASE + DMA_CONBLK_AD, (u32)&dmaSoundCB);
 	write32(DMA0_BASE + DMA_CS, DMA_ACTIVE);
 }
@@ -1141,6 +1228,17 @@ EXIT_TYPE __not_in_flash_func(Emulate1541) (FileBrowser* fileBrowser)
 		DEBUG_LOG("%s: .g64 hash = %x, refreshOutsAfterCPUStep = false", __FUNCTION__, hash);
 	}
 
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+	// Back from MINI SERVICE with the same active set: continue where the
+	// drive was instead of booting it.
+	if (EmuSnapshotApply(pi1541, s_u8Memory))
+	{
+		IEC_Bus::RefreshOuts1541();
+		cycleCount = FAST_BOOT_CYCLES;
+		BOOT_MARK(BOOT_PHASE_EMU_SNAPSHOT_RESTORE);
+	}
+#endif
+
 	// Quickly get through 1541's self test code.
 	// This will make the emulated 1541 responsive to commands asap.
 	// During this time we don't need to set outputs.
@@ -1897,6 +1995,10 @@ extern int mount_new;
 #endif
 
 			DEBUG_LOG("Exited emulation %d\r\n", exitReason);
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+			const bool saveSnapshot = exitReason == EXIT_SERVICE && emulating == EMULATING_1541 && g_activeFileInfoCount;
+			const u32 snapshotImageIndex = diskCaddy.GetSelectedIndex();
+#endif
 
 			// Clearing the caddy now
 			//	- will write back all changed/dirty/written to disk images now
@@ -1906,6 +2008,11 @@ extern int mount_new;
 			if (diskCaddy.Empty())
 				IEC_Bus::WaitMicroSeconds(2 * 1000000);
 			IEC_Bus::WaitUntilReset();
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+			// Hashed after the write-back, as the next boot will see the images.
+			if (saveSnapshot && !EmuSnapshotSave(pi1541, s_u8Memory, SnapshotRAMSize(), ActiveSetHash(true), snapshotImageIndex))
+				DEBUG_LOG("Service snapshot not saved\r\n");
+#endif
 			ClearActiveFileInfos();
 			emulating = IEC_COMMANDS;
 	
@@ -1926,6 +2033,7 @@ extern int mount_new;
 						screenLCD->PrintText(false, (u32) x, (u32) y, (char *) msg);
 						screenLCD->RefreshScreen();
 					}
+					BOOT_MARK(BOOT_PHASE_EMU_SERVICE_REQUEST, 1);
 					ChainBootChainloader("/kernel_chainloader.img");
 				}
 #endif
@@ -2427,6 +2535,7 @@ extern "C"
 		FRESULT res;
 		FATFS fileSystemSD;
 
+		BOOT_MARK(BOOT_PHASE_EMU_START);
 		DEBUG_LOG("Pi1541 Kernel Main\n");
 #if !defined(EXPERIMENTALZERO)		
 		FATFS fileSystemUSB[16];
@@ -2439,6 +2548,7 @@ extern "C"
 #endif
 		disk_setEMM(&m_EMMC);
 		f_mount(&fileSystemSD, "SD:", 1);
+		BOOT_MARK(BOOT_PHASE_EMU_FAT_MOUNT);
 #endif
 #if defined(ESP32)
 		initDiskImage();
@@ -2458,6 +2568,7 @@ extern "C"
     	}		
 #endif
 		LoadOptions();
+		BOOT_MARK(BOOT_PHASE_EMU_OPTIONS);
 #if defined(__CIRCLE__)
 		options.SetHeadLess(options.GetDisableHDMI());
 #endif			
@@ -2470,6 +2581,7 @@ extern "C"
 		write32(ARM_GPIO_GPCLR0, 0xFFFFFFFF);	//XXXPICO?
 #endif		
 		InitialiseLCD();
+		BOOT_MARK(BOOT_PHASE_EMU_LCD);
 
 #if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
 		// Split workflow boot policy:
@@ -2487,6 +2599,7 @@ extern "C"
 				screenLCD->PrintText(false, (u32)x, (u32)y, (char *)msg);
 				screenLCD->RefreshScreen();
 			}
+			BOOT_MARK(BOOT_PHASE_EMU_SERVICE_REQUEST, 0);
 			ChainBootChainloader("/kernel_chainloader.img");
 		}
 #endif
@@ -2529,6 +2642,10 @@ extern "C"
 		USPiInitialize();
 		numberOfUSBMassStorageDevices = USPiMassStorageDeviceAvailable();
 		DEBUG_LOG("%d USB Mass Storage Devices found\r\n", numberOfUSBMassStorageDevices);
+#if !defined (__CIRCLE__)
+		if (numberOfUSBMassStorageDevices > 0)
+			disk_setUSBReadAhead(options.USBReadAhead());
+#endif
 
 		USBKeyboardDetected = USPiKeyboardAvailable();
 		if (!USBKeyboardDetected)
@@ -2547,6 +2664,7 @@ extern "C"
 		//USPiMouseRegisterStatusHandler(MouseHandler);
 
 		CheckOptions();
+		BOOT_MARK(BOOT_PHASE_EMU_ROM_LOAD);
 		inputMappings->SetHoldMs(options.HoldMs());
 
 		IEC_Bus::SetSplitIECLines(options.SplitIECLines());
@@ -150,6 +150,7 @@ Options::Options(void)
 	, lowercaseBrowseModeFilenames(1)
 	, cdSlashSlashToRoot(0)
 	, startInUSBDrive(0)
+	, usbReadAhead(64)
 	, screenWidth(1024)
 	, screenHeight(768)
 	, i2cBusMaster(0)
@@ -163,6 +164,7 @@ Options::Options(void)
 	, i2cLcdModel(LCD_1306_128x64)
 	, scrollHighlightRate(0.125f)
 	, keyboardBrowseLCDScreen(0)
+	, keyboardSearchSubstring(0)
         , buttonEnter(1)
         , buttonUp(2)
         , buttonDown(3)
@@ -306,6 +308,7 @@ void Options::Process(char* buffer)
 		ELSE_CHECK_DECIMAL_OPTION(splitIECLines)
 		ELSE_CHECK_DECIMAL_OPTION(ignoreReset)
 		ELSE_CHECK_DECIMAL_OPTION(lowercaseBrowseModeFilenames)
+		ELSE_CHECK_DECIMAL_OPTION(usbReadAhead)
 		ELSE_CHECK_DECIMAL_OPTION(autoBootFB128)
 		ELSE_CHECK_DECIMAL_OPTION(displayTemperature)
 		ELSE_CHECK_DECIMAL_OPTION(screenWidth)
@@ -320,6 +323,7 @@ void Options::Process(char* buffer)
 		ELSE_CHECK_DECIMAL_OPTION(i2cLcdUseCBMChar)
 		ELSE_CHECK_FLOAT_OPTION(scrollHighlightRate)
 		ELSE_CHECK_DECIMAL_OPTION(keyboardBrowseLCDScreen)
+		ELSE_CHECK_DECIMAL_OPTION(keyboardSearchSubstring)
 		ELSE_CHECK_DECIMAL_OPTION(buttonEnter)
 		ELSE_CHECK_DECIMAL_OPTION(buttonUp)
 		ELSE_CHECK_DECIMAL_OPTION(buttonDown)
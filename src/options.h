@@ -98,6 +98,7 @@ public:
 
 	inline unsigned int CDSlashSlashToRoot() const { return cdSlashSlashToRoot; }
 	inline unsigned int StartInUSBDrive() const { return startInUSBDrive; }
+	inline unsigned int USBReadAhead() const { return usbReadAhead; }
 
 	DiskImage::DiskType GetNewDiskType() const;
 
@@ -149,6 +150,7 @@ public:
 	// Page up and down will jump a different amount based on the maximum number rows displayed.
 	// Perhaps we should use some keyboard modifier to the the other screen?
 	inline unsigned int KeyboardBrowseLCDScreen() const { return keyboardBrowseLCDScreen; }
+	inline unsigned int KeyboardSearchSubstring() const { return keyboardSearchSubstring; }
 
 	const char* GetLCDName() const { return LCDName; }
 
@@ -191,6 +193,7 @@ private:
 
 	unsigned int cdSlashSlashToRoot;
 	unsigned int startInUSBDrive;
+	unsigned int usbReadAhead;
 
 	unsigned int screenWidth;
 	unsigned int screenHeight;
@@ -208,6 +211,7 @@ private:
 	float scrollHighlightRate;
 
 	unsigned int keyboardBrowseLCDScreen;
+	unsigned int keyboardSearchSubstring;
 
         u8 buttonEnter;
         u8 buttonUp;
@@ -0,0 +1,65 @@
+// service/crc32.cpp - CRC32 (IEEE 802.3, reflected) for service transfers.
+
+#include "crc32.h"
+
+// Little-endian word loads (ARM as configured by Circle, and x86 hosts).
+static uint32_t s_crc_table[8][256];
+
+static void BuildTables(void)
+{
+	static bool have_table = false;
+	if (have_table)
+		return;
+
+	for (unsigned i = 0; i < 256; ++i)
+	{
+		uint32_t r = i;
+		for (unsigned j = 0; j < 8; ++j)
+			r = (r & 1) ? (r >> 1) ^ 0xEDB88320U : (r >> 1);
+		s_crc_table[0][i] = r;
+	}
+	for (unsigned i = 0; i < 256; ++i)
+	{
+		for (unsigned k = 1; k < 8; ++k)
+		{
+			const uint32_t prev = s_crc_table[k - 1][i];
+			s_crc_table[k][i] = (prev >> 8) ^ s_crc_table[0][prev & 0xFF];
+		}
+	}
+	have_table = true;
+}
+
+uint32_t Crc32UpdateBytewise(uint32_t crc, const uint8_t *data, size_t len)
+{
+	BuildTables();
+	while (len--)
+		crc = s_crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+uint32_t Crc32Update(uint32_t crc, const uint8_t *data, size_t len)
+{
+	BuildTables();
+
+	while (len && (reinterpret_cast<uintptr_t>(data) & 3))
+	{
+		crc = s_crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+		--len;
+	}
+
+	const uint32_t *words = reinterpret_cast<const uint32_t *>(data);
+	for (; len >= 8; len -= 8)
+	{
+		const uint32_t one = *words++ ^ crc;
+		const uint32_t two = *words++;
+		crc = s_crc_table[7][one & 0xFF] ^ s_crc_table[6][(one >> 8) & 0xFF]
+		    ^ s_crc_table[5][(one >> 16) & 0xFF] ^ s_crc_table[4][one >> 24]
+		    ^ s_crc_table[3][two & 0xFF] ^ s_crc_table[2][(two >> 8) & 0xFF]
+		    ^ s_crc_table[1][(two >> 16) & 0xFF] ^ s_crc_table[0][two >> 24];
+	}
+
+	data = reinterpret_cast<const uint8_t *>(words);
+	while (len--)
+		crc = s_crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
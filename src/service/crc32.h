@@ -0,0 +1,19 @@
+// service/crc32.h - CRC32 (IEEE 802.3, reflected) for service transfers.
+//
+// Crc32Update() uses slicing-by-8: one pass over eight 256-entry tables per
+// 8 input bytes instead of a lookup per byte. Crc32UpdateBytewise() is the
+// one-lookup-per-byte reference tools/crcbench checks it against.
+// Both take and return the running (non-inverted) register: start with
+// 0xFFFFFFFF and invert the result.
+// No Circle dependencies, so host tools can build it as is.
+
+#ifndef NETSERVICE_CRC32_H
+#define NETSERVICE_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t Crc32Update(uint32_t crc, const uint8_t *data, size_t len);
+uint32_t Crc32UpdateBytewise(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif
@@ -6,13 +6,18 @@
 
 #include "http_server.h"
 #include "service.h"
+#include "crc32.h"
 
+#include "boot_timeline.h"
 #include "options.h"
 
 #include <circle/bcmrandom.h>
 #include <circle/net/http.h>
 #include <circle/net/in.h>
+#include <circle/net/ipaddress.h>
+#include <circle/net/socket.h>
 #include <circle/string.h>
+#include <circle/timer.h>
 #include <circle/types.h>
 
 #include <fatfs/ff.h>
@@ -23,7 +28,53 @@
 #include <stdlib.h>
 #include <string.h>
 
-static constexpr unsigned kMaxContentSize = 8 * 1024 * 1024;
+// Response buffer per connection: JSON, index.html (96 KB budget) and the font.
+// Uploads and file downloads are streamed and do not need it.
+static constexpr unsigned kMaxContentSize = 128 * 1024;
+
+// Circle's THTTPStatus only names the codes its own worker uses.
+static constexpr THTTPStatus kHTTPPartialContent = static_cast<THTTPStatus>(206);
+static constexpr THTTPStatus kHTTPNotModified = static_cast<THTTPStatus>(304);
+static constexpr THTTPStatus kHTTPMethodNotAllowed = static_cast<THTTPStatus>(405);
+static constexpr THTTPStatus kHTTPRangeNotSatisfiable = static_cast<THTTPStatus>(416);
+
+// Route table (s_Routes) method and flag bits.
+static constexpr unsigned kMethodGet = 1U << HTTPRequestMethodGet;
+static constexpr unsigned kMethodHead = 1U << HTTPRequestMethodHead;
+static constexpr unsigned kMethodPost = 1U << HTTPRequestMethodPost;
+static constexpr unsigned kMethodUpload = (1U << HTTPRequestMethodPut) | kMethodPost;
+
+static constexpr unsigned kRoutePrefix = 1U << 0;	// "<path>/<arg>" also matches
+static constexpr unsigned kRouteNonce = 1U << 1;	// X-Nonce must match
+static constexpr unsigned kRouteUploadBody = 1U << 2;	// raw body streamed to _incoming/
+static constexpr unsigned kRouteAppend = 1U << 3;	// upload adds to the queue
+
+static inline unsigned MethodBit(THTTPRequestMethod method)
+{
+	return method < 32 ? 1U << method : 0;
+}
+
+// kMethod* bits -> "GET, HEAD" for the Allow header of a 405.
+static void FormatMethods(unsigned methods, char *out, size_t size)
+{
+	static const struct { THTTPRequestMethod method; const char *name; } names[] = {
+		{ HTTPRequestMethodGet, "GET" },
+		{ HTTPRequestMethodHead, "HEAD" },
+		{ HTTPRequestMethodPost, "POST" },
+		{ HTTPRequestMethodPut, "PUT" },
+	};
+	size_t n = 0;
+	out[0] = '\0';
+	for (const auto &entry : names)
+	{
+		if (!(methods & MethodBit(entry.method)))
+			continue;
+		const int w = snprintf(out + n, size - n, "%s%s", n ? ", " : "", entry.name);
+		if (w < 0 || static_cast<size_t>(w) >= size - n)
+			break;
+		n += static_cast<size_t>(w);
+	}
+}
 
 static const char kMetaContentType[] = "application/json";
 static const char kMetaHtmlType[] = "text/html; charset=utf-8";
@@ -41,12 +92,60 @@ static char g_pending_names[kPendingMax][64];
 static unsigned g_pending_count = 0;
 static uint32_t g_pending_nonce = 0;
 
+// Whole-file CRC32 (not finalized) of the committed part of the last chunked
+// upload, so the next chunk does not have to re-read <name>.tmp from SD.
+static char g_resume_name[64];
+static uint32_t g_resume_offset = 0;
+static uint32_t g_resume_crc = 0;
+
 static uint32_t g_nonce = 0;
 static volatile bool g_teardown_requested = false;
 
+// GET /metrics. Shared by all workers; Circle's scheduler is cooperative, so
+// plain counters need no locking. Times come from the 1 MHz clock ticks.
+static constexpr unsigned kLatencyBuckets = 8;		// <= 1, 4, 16, ... 4096 ms, more
+static constexpr unsigned kRouteMetricsMax = 16;	// s_Routes rows, last = no route
+
+struct TRouteMetrics
+{
+	uint32_t count;
+	uint32_t errors;		// status >= 400
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t total_us;
+	uint32_t max_us;
+	uint32_t buckets[kLatencyBuckets];
+};
+
+struct TTimedMetrics
+{
+	uint32_t count;
+	uint64_t bytes;
+	uint64_t total_us;
+	uint32_t max_us;
+};
+
+static TRouteMetrics g_route_metrics[kRouteMetricsMax];
+static TTimedMetrics g_sd_write_metrics;	// f_write/f_sync of uploads
+static TTimedMetrics g_crc_metrics;		// TimedCrc32Update()
+static TTimedMetrics g_commit_metrics;		// CommitPendingUploads()
+
+static void CountTimed(TTimedMetrics &metrics, uint64_t bytes, unsigned start_ticks)
+{
+	const uint32_t us = CTimer::GetClockTicks() - start_ticks;
+	++metrics.count;
+	metrics.bytes += bytes;
+	metrics.total_us += us;
+	if (us > metrics.max_us)
+		metrics.max_us = us;
+}
+
 static constexpr unsigned kModifiedMax = 32;
 static char g_modified_display[kModifiedMax][64];
+// Where downloads read from: the image in _active_mount/ until its snapshot in
+// the session dir has been taken (g_modified_pending cleared), then the copy.
 static char g_modified_cached[kModifiedMax][256];
+static bool g_modified_pending[kModifiedMax];
 static unsigned g_modified_count = 0;
 static uint32_t g_modified_id = 0;
 static char g_modified_session[32];
@@ -59,7 +158,19 @@ static const unsigned char s_Font[] = {
 #include "webcontent/C64_Pro_Mono-STYLE.h"
 };
 
-static uint32_t Crc32Update(uint32_t crc, const u8 *data, size_t len);
+// gzip -9 copies generated by the webcontent Makefiles.
+static const unsigned char s_IndexGz[] = {
+#include "webcontent/miniservice/index.gz.h"
+};
+
+static const unsigned char s_FontGz[] = {
+#include "webcontent/C64_Pro_Mono-STYLE.gz.h"
+};
+
+static uint32_t TimedCrc32Update(uint32_t crc, const u8 *data, size_t len);
+static void SnapshotNextModified(u8 *buffer, unsigned buffer_len);
+static bool SnapshotAllModified(u8 *buffer, unsigned buffer_len);
+static void ForgetFileCrc(const char *path);
 static void SanitizeFilename(const char *input, char *output, size_t output_len);
 
 static constexpr size_t kMaxLineLength = 512;
@@ -413,9 +524,12 @@ static bool CopyFile(const char *src_path, const char *dst_path)
 		f_close(&in);
 		return false;
 	}
+	ForgetFileCrc(dst_path);
 
+	// Whole clusters per call: FatFs moves them straight between the buffer and
+	// the card instead of one sector at a time through its window.
+	static u8 buf[32 * 1024] __attribute__((aligned(64)));
 	UINT rb = 0, wb = 0;
-	u8 buf[4096];
 	for (;;)
 	{
 		if (f_read(&in, buf, sizeof(buf), &rb) != FR_OK || rb == 0)
@@ -482,61 +596,74 @@ static bool OpenModifiedList(FIL *fp)
 	return f_open(fp, kModifiedListPath, FA_READ) == FR_OK;
 }
 
-static bool ReadModifiedListSummary(unsigned *out_count, uint32_t *out_crc)
+// Calls on_line() for every non-empty, trimmed line of dirty.lst; *out_crc is
+// the CRC of the raw file (the list id /hello reports).
+template <typename TLineHandler>
+static bool ForEachModifiedLine(uint32_t *out_crc, TLineHandler on_line)
 {
-	if (out_count)
-		*out_count = 0;
-	if (out_crc)
-		*out_crc = 0;
-
 	FIL fp;
 	if (!OpenModifiedList(&fp))
 		return false;
 
+	static char chunk[2048];
 	uint32_t crc = 0;
-	unsigned count = 0;
 	char line[kMaxLineLength];
 	unsigned pos = 0;
-
 	UINT br = 0;
-	char ch = 0;
-	while (f_read(&fp, &ch, 1, &br) == FR_OK && br == 1)
+	while (f_read(&fp, chunk, sizeof(chunk), &br) == FR_OK && br)
 	{
-		crc = Crc32Update(crc, (const u8 *)&ch, 1);
-		if (ch == '\n')
+		crc = TimedCrc32Update(crc, reinterpret_cast<const u8 *>(chunk), br);
+		for (UINT i = 0; i < br; ++i)
 		{
+			const char ch = chunk[i];
+			if (ch != '\n')
+			{
+				if (pos + 1 < sizeof(line))
+					line[pos++] = ch;
+				continue;
+			}
 			line[pos] = '\0';
+			pos = 0;
 			TrimLine(line);
 			if (line[0])
-				++count;
-			pos = 0;
-			continue;
+				on_line(line);
 		}
-		if (pos + 1 < sizeof(line))
-			line[pos++] = ch;
 	}
+	f_close(&fp);
+
+	// Last line without newline.
 	if (pos)
 	{
 		line[pos] = '\0';
 		TrimLine(line);
 		if (line[0])
-			++count;
+			on_line(line);
 	}
-	f_close(&fp);
-
-	if (out_count)
-		*out_count = count;
 	if (out_crc)
 		*out_crc = crc;
 	return true;
 }
 
-static bool PopulateModifiedListDirect(uint32_t crc, const char *session_dir)
+static bool ReadModifiedListSummary(unsigned *out_count, uint32_t *out_crc)
 {
-	FIL fp;
-	if (!OpenModifiedList(&fp))
+	if (out_count)
+		*out_count = 0;
+	if (out_crc)
+		*out_crc = 0;
+
+	unsigned count = 0;
+	if (!ForEachModifiedLine(out_crc, [&count](const char *) { ++count; }))
 		return false;
+	if (out_count)
+		*out_count = count;
+	return true;
+}
 
+// Only parses the list: snapshots are taken later, one disk at a time, by
+// SnapshotModified() (on download, or after /hello answered), and all that
+// are left by SnapshotAllModified() before a commit clears _active_mount/.
+static bool PopulateModifiedListDirect(uint32_t crc, const char *session_dir)
+{
 	g_modified_count = 0;
 	g_modified_id = crc;
 	if (!session_dir)
@@ -551,100 +678,27 @@ static bool PopulateModifiedListDirect(uint32_t crc, const char *session_dir)
 	{
 		g_modified_display[i][0] = '\0';
 		g_modified_cached[i][0] = '\0';
+		g_modified_pending[i] = false;
 	}
 
-	char line[kMaxLineLength];
-	unsigned pos = 0;
-	UINT br = 0;
-	char ch = 0;
-	while (f_read(&fp, &ch, 1, &br) == FR_OK && br == 1)
-	{
-		if (ch == '\r')
-			continue;
-		if (ch == '\n')
-		{
-			line[pos] = '\0';
-			TrimLine(line);
-			pos = 0;
-			if (!line[0] || g_modified_count >= kModifiedMax)
-				continue;
-
-			char src_full[kMaxPathLength];
-			if (!NormalizeModifiedSourcePath(line, src_full, sizeof(src_full)))
-				continue;
-			const char *src_path = src_full;
-			if (!IsAllowedModifiedPath(src_path))
-				continue;
-
-			char base[64];
-			BasenameOf(src_path, base, sizeof(base));
-			snprintf(g_modified_display[g_modified_count], sizeof(g_modified_display[g_modified_count]), "%s", base);
-
-			if (session_dir && session_dir[0])
-			{
-				char safe[64];
-				SanitizeFilename(base, safe, sizeof(safe));
-				if (!safe[0])
-					snprintf(safe, sizeof(safe), "disk_%u.bin", g_modified_count + 1);
-
-				char dst[256];
-				snprintf(dst, sizeof(dst), "%s/%02u_%s", session_dir, g_modified_count + 1, safe);
-				if (CopyFile(src_path, dst))
-					snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", dst);
-				else
-					snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", src_path);
-			}
-			else
-			{
-				snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", src_path);
-			}
-			++g_modified_count;
-			continue;
-		}
-		if (pos + 1 < sizeof(line))
-			line[pos++] = ch;
-	}
+	const bool snapshot = session_dir && session_dir[0];
+	ForEachModifiedLine(nullptr, [snapshot](const char *line) {
+		if (g_modified_count >= kModifiedMax)
+			return;
 
-	// Handle last line without newline.
-	if (pos && g_modified_count < kModifiedMax)
-	{
-		line[pos] = '\0';
-		TrimLine(line);
-		if (line[0])
-		{
-			char src_full[kMaxPathLength];
-			if (!NormalizeModifiedSourcePath(line, src_full, sizeof(src_full)))
-				goto modified_done;
-			const char *src_path = src_full;
-			if (IsAllowedModifiedPath(src_path))
-			{
-				char base[64];
-				BasenameOf(src_path, base, sizeof(base));
-				snprintf(g_modified_display[g_modified_count], sizeof(g_modified_display[g_modified_count]), "%s", base);
-				if (session_dir && session_dir[0])
-				{
-					char safe[64];
-					SanitizeFilename(base, safe, sizeof(safe));
-					if (!safe[0])
-						snprintf(safe, sizeof(safe), "disk_%u.bin", g_modified_count + 1);
-					char dst[256];
-					snprintf(dst, sizeof(dst), "%s/%02u_%s", session_dir, g_modified_count + 1, safe);
-					if (CopyFile(src_path, dst))
-						snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", dst);
-					else
-						snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", src_path);
-				}
-				else
-				{
-					snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", src_path);
-				}
-				++g_modified_count;
-			}
-		}
-	}
+		char src_path[kMaxPathLength];
+		if (!NormalizeModifiedSourcePath(line, src_path, sizeof(src_path)))
+			return;
+		if (!IsAllowedModifiedPath(src_path))
+			return;
 
-modified_done:
-	f_close(&fp);
+		char base[64];
+		BasenameOf(src_path, base, sizeof(base));
+		snprintf(g_modified_display[g_modified_count], sizeof(g_modified_display[g_modified_count]), "%s", base);
+		snprintf(g_modified_cached[g_modified_count], sizeof(g_modified_cached[g_modified_count]), "%s", src_path);
+		g_modified_pending[g_modified_count] = snapshot;
+		++g_modified_count;
+	});
 	return g_modified_count != 0;
 }
 
@@ -822,24 +876,11 @@ static void EnsureExtension(char *name, size_t name_len, const char *type_hint)
 	strncat(name, ext, name_len - strlen(name) - 1);
 }
 
-static uint32_t Crc32Update(uint32_t crc, const u8 *data, size_t len)
+static uint32_t TimedCrc32Update(uint32_t crc, const u8 *data, size_t len)
 {
-	static uint32_t table[256];
-	static bool have_table = false;
-	if (!have_table)
-	{
-		for (unsigned i = 0; i < 256; ++i)
-		{
-			uint32_t r = i;
-			for (unsigned j = 0; j < 8; ++j)
-				r = (r & 1) ? (r >> 1) ^ 0xEDB88320U : (r >> 1);
-			table[i] = r;
-		}
-		have_table = true;
-	}
-
-	for (size_t i = 0; i < len; ++i)
-		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	const unsigned start = CTimer::GetClockTicks();
+	crc = Crc32Update(crc, data, len);
+	CountTimed(g_crc_metrics, len, start);
 	return crc;
 }
 
@@ -921,10 +962,15 @@ static bool WriteActiveListFromPending(void)
 	return f_rename(kActiveListTmpPath, kActiveListPath) == FR_OK;
 }
 
-static bool CommitPendingUploads(void)
+static bool CommitPendingUploads(u8 *buffer, unsigned buffer_len)
 {
 	if (g_pending_count == 0)
 		return false;
+	// Modified disks still only in _active_mount/ would be lost below.
+	if (!SnapshotAllModified(buffer, buffer_len))
+		return false;
+	// Every file under _active_mount/ is replaced below.
+	ForgetFileCrc(nullptr);
 	if (!ClearActiveMountDir())
 		return false;
 
@@ -949,6 +995,14 @@ static bool CommitPendingUploads(void)
 	return true;
 }
 
+static bool CommitPendingUploadsTimed(u8 *buffer, unsigned buffer_len)
+{
+	const unsigned start = CTimer::GetClockTicks();
+	const bool ok = CommitPendingUploads(buffer, buffer_len);
+	CountTimed(g_commit_metrics, 0, start);
+	return ok;
+}
+
 static THTTPStatus WriteJsonResult(u8 *pBuffer, unsigned *pLength, const char *result)
 {
 	if (!pBuffer || !pLength || !result)
@@ -963,23 +1017,6 @@ static THTTPStatus WriteJsonResult(u8 *pBuffer, unsigned *pLength, const char *r
 	return HTTPOK;
 }
 
-static THTTPStatus WriteTextResult(u8 *pBuffer, unsigned *pLength, const char *text)
-{
-	if (!pBuffer || !pLength || !text)
-		return HTTPInternalServerError;
-
-	const unsigned nLength = static_cast<unsigned>(strlen(text));
-	if (nLength > *pLength)
-	{
-		*pLength = 0;
-		return HTTPRequestEntityTooLarge;
-	}
-
-	memcpy(pBuffer, text, nLength);
-	*pLength = nLength;
-	return HTTPOK;
-}
-
 static THTTPStatus WriteBinaryResult(u8 *pBuffer, unsigned *pLength, const unsigned char *data, unsigned data_len)
 {
 	if (!pBuffer || !pLength || !data)
@@ -1018,47 +1055,97 @@ static bool StartsWithI(const char *s, const char *prefix)
 	return true;
 }
 
-THTTPStatus CServiceHttpServer::HandleUpload(u8 *pBuffer, unsigned *pLength, bool append_list, bool mark_complete)
+boolean CServiceHttpServer::BeginRawBody(const char *pPath, unsigned nContentLength)
 {
-	const char *nonce_text = GetHeaderValue("X-Nonce");
-	uint32_t nonce = 0;
-	if (!ParseU32(nonce_text, &nonce) || nonce != g_nonce)
-		return WriteJsonError(pBuffer, pLength, "BAD_NONCE");
+	const THTTPRequestMethod method = GetRequestMethod();
+	if (method != HTTPRequestMethodPut && method != HTTPRequestMethodPost)
+		return FALSE;
+
+	char path[kMaxPathLength];
+	const char *arg = nullptr;
+	const TRoute *route = FindRoute(pPath, path, sizeof(path), &arg);
+	if (!route || !(route->nFlags & kRouteUploadBody))
+		return FALSE;
+
+	// Errors are reported by HandleUpload() once the body has been consumed.
+	m_pUploadError = BeginUpload(nContentLength, (route->nFlags & kRouteAppend) != 0);
+	return TRUE;
+}
 
-	// Uploads must be raw bytes. Circle treats form/multipart differently and
-	// won't populate the raw request body buffer in those modes.
-	const char *ct = GetHeaderValue("Content-Type");
-	if (!ct || !ct[0] || !StartsWithI(ct, "application/octet-stream"))
-		return WriteJsonError(pBuffer, pLength, "BAD_CONTENT_TYPE");
+boolean CServiceHttpServer::ReceiveRawBody(const u8 *pData, unsigned nLength)
+{
+	m_nBytesIn += nLength;
+	if (!m_bUploadOpen)
+		return TRUE; // failed upload: drain the body, the error is reported afterwards
 
-	unsigned body_len = 0;
-	const u8 *body = GetRawRequestBody(&body_len);
-	if (!body || body_len == 0)
-		return WriteJsonError(pBuffer, pLength, "NO_BODY");
+	if (m_pUploadDecoder)
+	{
+		if (!m_pUploadDecoder->Write(pData, nLength, DecodedUploadData, this) && m_bUploadOpen)
+		{
+			AbortUpload();
+			m_pUploadError = "BAD_LZ4";
+		}
+		return TRUE;
+	}
 
-	const char *size_text = GetHeaderValue("X-Image-Size");
-	uint32_t expected_size = 0;
-	if (!size_text || !size_text[0])
-		return WriteJsonError(pBuffer, pLength, "NO_SIZE");
-	if (!ParseU32(size_text, &expected_size) || expected_size != body_len)
-		return WriteJsonError(pBuffer, pLength, "BAD_SIZE");
+	WriteUploadData(pData, nLength);
+	return TRUE;
+}
 
-	const char *crc_text = GetHeaderValue("X-CRC32");
-	uint32_t expected_crc = 0;
-	if (!crc_text || !crc_text[0])
-		return WriteJsonError(pBuffer, pLength, "NO_CRC");
-	if (!ParseU32(crc_text, &expected_crc))
-		return WriteJsonError(pBuffer, pLength, "BAD_CRC");
+bool CServiceHttpServer::DecodedUploadData(void *pContext, const u8 *pData, unsigned nLength)
+{
+	return static_cast<CServiceHttpServer *>(pContext)->WriteUploadData(pData, nLength);
+}
 
+// Decoded upload bytes: CRCs, then whole 4 KB blocks to SD. On failure the
+// upload is aborted and m_pUploadError set.
+bool CServiceHttpServer::WriteUploadData(const u8 *pData, unsigned nLength)
+{
+	// Raw bodies were size-checked against Content-Length up front; compressed
+	// ones only show their size here.
+	if (m_nUploadOffset + m_nUploadSize + nLength > m_nUploadTotal)
+	{
+		AbortUpload();
+		m_pUploadError = "BAD_SIZE";
+		return false;
+	}
+
+	m_nUploadCrc = TimedCrc32Update(m_nUploadCrc, pData, nLength);
+	if (m_bUploadChunked)
+		m_nChunkCrc = TimedCrc32Update(m_nChunkCrc, pData, nLength);
+	m_nUploadSize += nLength;
+
+	// Collect whole 4 KB blocks so FatFs can write them sector aligned.
+	while (nLength)
+	{
+		unsigned take = sizeof(m_IoBuffer) - m_nUploadBuffered;
+		if (take > nLength)
+			take = nLength;
+		memcpy(m_IoBuffer + m_nUploadBuffered, pData, take);
+		m_nUploadBuffered += take;
+		pData += take;
+		nLength -= take;
+
+		if (m_nUploadBuffered == sizeof(m_IoBuffer) && !FlushUpload())
+		{
+			AbortUpload();
+			m_pUploadError = "FS_WRITE";
+			return false;
+		}
+	}
+	return true;
+}
+
+void CServiceHttpServer::ResolveUploadName(bool append_list, char *name, size_t name_len)
+{
 	char orig_name[64];
 	SanitizeFilename(GetHeaderValue("X-Image-Name"), orig_name, sizeof(orig_name));
 
 	const char *type_hint = GetHeaderValue("X-Image-Type");
 
-	char name[64];
 	if (!append_list)
 	{
-		snprintf(name, sizeof(name), "ACTIVE");
+		snprintf(name, name_len, "ACTIVE");
 		if ((!type_hint || !type_hint[0]) && orig_name[0])
 		{
 			const char *ext = strrchr(orig_name, '.');
@@ -1069,100 +1156,345 @@ THTTPStatus CServiceHttpServer::HandleUpload(u8 *pBuffer, unsigned *pLength, boo
 	else
 	{
 		if (orig_name[0])
-			snprintf(name, sizeof(name), "%s", orig_name);
+			snprintf(name, name_len, "%s", orig_name);
 		else
-			snprintf(name, sizeof(name), "upload");
+			snprintf(name, name_len, "upload");
 	}
-	EnsureExtension(name, sizeof(name), type_hint);
+	EnsureExtension(name, name_len, type_hint);
+}
 
-	ResetPendingUploads(nonce, !append_list);
-	if (!EnsureServiceDirs())
-		return WriteJsonError(pBuffer, pLength, "FS_DIR");
+const char *CServiceHttpServer::BeginUpload(unsigned content_length, bool append_list)
+{
+	const char *nonce_text = GetHeaderValue("X-Nonce");
+	uint32_t nonce = 0;
+	if (!ParseU32(nonce_text, &nonce) || nonce != g_nonce)
+		return "BAD_NONCE";
 
-	char temp_path[256];
-	char final_path[256];
-	snprintf(temp_path, sizeof(temp_path), "%s/%s.tmp", kIncomingDir, name);
-	snprintf(final_path, sizeof(final_path), "%s/%s", kIncomingDir, name);
+	// Uploads must be raw bytes. Circle treats form/multipart differently and
+	// never hands those bodies to ReceiveRawBody().
+	const char *ct = GetHeaderValue("Content-Type");
+	if (!ct || !ct[0] || !StartsWithI(ct, "application/octet-stream"))
+		return "BAD_CONTENT_TYPE";
+
+	// Chunked (resumable) uploads send X-Upload-Offset + X-Chunk-CRC32 per
+	// chunk; X-Image-Size and X-CRC32 always describe the whole file.
+	const char *offset_text = GetHeaderValue("X-Upload-Offset");
+	m_bUploadChunked = offset_text && offset_text[0];
+	m_nUploadOffset = 0;
+	if (m_bUploadChunked)
+	{
+		if (!ParseU32(offset_text, &m_nUploadOffset))
+			return "BAD_OFFSET";
+		const char *chunk_crc_text = GetHeaderValue("X-Chunk-CRC32");
+		if (!chunk_crc_text || !chunk_crc_text[0])
+			return "NO_CHUNK_CRC";
+		if (!ParseU32(chunk_crc_text, &m_nChunkExpectedCrc))
+			return "BAD_CHUNK_CRC";
+	}
 
-	FIL fp;
-	FRESULT fr = f_open(&fp, temp_path, FA_CREATE_ALWAYS | FA_WRITE);
-	if (fr != FR_OK)
-		return WriteJsonError(pBuffer, pLength, "FS_OPEN");
+	// Content-Encoding: lz4 (LZ4 frame, 64 KB blocks) is decoded as it
+	// arrives; offsets, sizes and CRCs then refer to the decoded bytes, and each
+	// chunk of a chunked upload is a frame of its own.
+	const char *encoding = GetHeaderValue("Content-Encoding");
+	const bool lz4 = encoding && encoding[0] && !StartsWithI(encoding, "identity");
+	if (lz4 && !StartsWithI(encoding, "lz4"))
+		return "BAD_ENCODING";
 
-	uint32_t crc = 0xFFFFFFFFU;
-	UINT written = 0;
-	const unsigned chunk = 4096;
-	unsigned offset = 0;
-	while (offset < body_len)
-	{
-		unsigned left = body_len - offset;
-		unsigned take = left > chunk ? chunk : left;
-		fr = f_write(&fp, body + offset, take, &written);
-		if (fr != FR_OK || written != take)
-		{
-			f_close(&fp);
-			f_unlink(temp_path);
-			return WriteJsonError(pBuffer, pLength, "FS_WRITE");
-		}
-		crc = Crc32Update(crc, body + offset, take);
-		offset += take;
-	}
-	crc ^= 0xFFFFFFFFU;
-	f_sync(&fp);
-	f_close(&fp);
+	const char *size_text = GetHeaderValue("X-Image-Size");
+	if (!size_text || !size_text[0])
+		return "NO_SIZE";
+	if (!ParseU32(size_text, &m_nUploadTotal))
+		return "BAD_SIZE";
+	if (lz4 ? m_nUploadOffset > m_nUploadTotal
+		: m_bUploadChunked ? m_nUploadOffset + content_length > m_nUploadTotal
+				   : m_nUploadTotal != content_length)
+		return "BAD_SIZE";
 
-	if (crc != expected_crc)
+	const char *crc_text = GetHeaderValue("X-CRC32");
+	uint32_t expected_crc = 0;
+	if (!crc_text || !crc_text[0])
+		return "NO_CRC";
+	if (!ParseU32(crc_text, &expected_crc))
+		return "BAD_CRC";
+
+	if (lz4)
 	{
-		f_unlink(temp_path);
-		return WriteJsonError(pBuffer, pLength, "BAD_CRC");
+		m_pUploadDecoder = new CLz4FrameDecoder;
+		if (!m_pUploadDecoder || !m_pUploadDecoder->Initialize())
+			return "NO_MEMORY";
 	}
 
-	f_unlink(final_path);
-	if (f_rename(temp_path, final_path) != FR_OK)
+	ResolveUploadName(append_list, m_UploadName, sizeof(m_UploadName));
+
+	ResetPendingUploads(nonce, !append_list);
+	if (!EnsureServiceDirs())
+		return "FS_DIR";
+
+	snprintf(m_UploadTempPath, sizeof(m_UploadTempPath), "%s/%s.tmp", kIncomingDir, m_UploadName);
+	m_nUploadCrc = 0xFFFFFFFFU;
+	m_nChunkCrc = 0xFFFFFFFFU;
+	m_nUploadSize = 0;
+	m_nUploadBuffered = 0;
+
+	if (m_nUploadOffset == 0)
 	{
-		f_unlink(temp_path);
-		return WriteJsonError(pBuffer, pLength, "FS_RENAME");
+		if (f_open(&m_UploadFile, m_UploadTempPath, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+			return "FS_OPEN";
+		m_bUploadOpen = true;
+		return nullptr;
 	}
 
-	if (!AddPendingUpload(name))
+	// Resume: the chunk must start exactly where the committed part ends
+	// (the .tmp is synced after every chunk, so its size is that offset).
+	if (f_open(&m_UploadFile, m_UploadTempPath, FA_READ | FA_WRITE | FA_OPEN_EXISTING) != FR_OK)
 	{
-		f_unlink(final_path);
-		return WriteJsonError(pBuffer, pLength, "QUEUE_FULL");
+		m_nUploadOffset = 0;
+		return "BAD_OFFSET";
 	}
-
-	if (mark_complete)
+	m_bUploadOpen = true;
+	if (f_size(&m_UploadFile) != m_nUploadOffset)
 	{
-		if (!CommitPendingUploads())
-			return WriteJsonError(pBuffer, pLength, "FS_COMMIT");
+		m_nUploadOffset = static_cast<uint32_t>(f_size(&m_UploadFile));
+		f_close(&m_UploadFile);
+		m_bUploadOpen = false;
+		return "BAD_OFFSET";
+	}
 
-		// Current behavior: successful commit requests teardown automatically.
-		// Future option: keep commit non-rebooting (return {ok:true}) and add an
-		// explicit `POST /teardown` call from the frontend to reboot immediately
-		// after the response is received.
-		CServiceHttpServer::RequestTeardown();
+	// Whole-file CRC so far: cached from the previous chunk, or re-read from SD
+	// (e.g. after a service restart).
+	if (g_resume_offset == m_nUploadOffset && strcmp(g_resume_name, m_UploadName) == 0)
+	{
+		m_nUploadCrc = g_resume_crc;
 	}
+	else
+	{
+		UINT br = 0;
+		while (f_read(&m_UploadFile, m_IoBuffer, sizeof(m_IoBuffer), &br) == FR_OK && br)
+			m_nUploadCrc = TimedCrc32Update(m_nUploadCrc, m_IoBuffer, br);
+	}
+	if (f_lseek(&m_UploadFile, m_nUploadOffset) != FR_OK)
+	{
+		AbortUpload();
+		return "FS_OPEN";
+	}
+	return nullptr;
+}
 
-	char response[256];
-	const char *rebooting = mark_complete ? "true" : "false";
-	snprintf(response, sizeof(response),
-		 "{\"ok\":true,\"name\":\"%s\",\"size\":%u,\"crc32\":\"%08x\",\"rebooting\":%s}",
-		 name, body_len, static_cast<unsigned>(crc), rebooting);
-	return WriteJsonResult(pBuffer, pLength, response);
+bool CServiceHttpServer::FlushUpload(void)
+{
+	if (m_nUploadBuffered == 0)
+		return true;
+
+	const unsigned start = CTimer::GetClockTicks();
+	UINT written = 0;
+	const FRESULT fr = f_write(&m_UploadFile, m_IoBuffer, m_nUploadBuffered, &written);
+	const bool ok = fr == FR_OK && written == m_nUploadBuffered;
+	CountTimed(g_sd_write_metrics, written, start);
+	m_nUploadBuffered = 0;
+	return ok;
 }
 
-CServiceHttpServer::CServiceHttpServer(CNetSubSystem *pNetSubSystem, CSocket *pSocket)
-	: CHTTPDaemon(pNetSubSystem, pSocket, kMaxContentSize, service_http_port(), 0),
-	  m_pNetSubSystem(pNetSubSystem)
+void CServiceHttpServer::AbortUpload(void)
 {
-	if (g_nonce == 0)
+	if (!m_bUploadOpen)
+		return;
+	m_bUploadOpen = false;
+
+	// A chunked upload keeps what was committed by earlier chunks so the
+	// client can resume; only the unverified part of this chunk is dropped.
+	if (m_bUploadChunked && m_nUploadOffset)
 	{
-		g_nonce = MakeNonce();
+		f_lseek(&m_UploadFile, m_nUploadOffset);
+		f_truncate(&m_UploadFile);
+		f_close(&m_UploadFile);
+		return;
 	}
+	f_close(&m_UploadFile);
+	f_unlink(m_UploadTempPath);
 }
 
-CServiceHttpServer::~CServiceHttpServer(void) = default;
-
-void CServiceHttpServer::RequestTeardown(void)
+THTTPStatus CServiceHttpServer::WriteUploadError(u8 *pBuffer, unsigned *pLength, const char *error)
+{
+	if (!m_bUploadChunked)
+		return WriteJsonError(pBuffer, pLength, error);
+
+	// Tell a resuming client where to continue from.
+	char temp[256];
+	snprintf(temp, sizeof(temp), "{\"ok\":false,\"error\":\"%s\",\"offset\":%u}",
+		 error, static_cast<unsigned>(m_nUploadOffset));
+	return WriteJsonResult(pBuffer, pLength, temp);
+}
+
+THTTPStatus CServiceHttpServer::HandleUploadOffset(u8 *pBuffer, unsigned *pLength, bool append_list)
+{
+	char name[64];
+	ResolveUploadName(append_list, name, sizeof(name));
+
+	char temp_path[256];
+	snprintf(temp_path, sizeof(temp_path), "%s/%s.tmp", kIncomingDir, name);
+	FILINFO fi;
+	const unsigned offset = f_stat(temp_path, &fi) == FR_OK ? static_cast<unsigned>(fi.fsize) : 0;
+
+	char response[256];
+	snprintf(response, sizeof(response), "{\"ok\":true,\"name\":\"%s\",\"offset\":%u}", name, offset);
+	return WriteJsonResult(pBuffer, pLength, response);
+}
+
+THTTPStatus CServiceHttpServer::HandleUpload(u8 *pBuffer, unsigned *pLength, bool append_list, bool mark_complete)
+{
+	(void) append_list;
+
+	// Header checks and the SD writes already happened while the body was
+	// received (BeginRawBody/ReceiveRawBody).
+	if (!IsRawBodyStreamed())
+		return WriteJsonError(pBuffer, pLength, "NO_BODY");
+	if (m_pUploadError)
+		return WriteUploadError(pBuffer, pLength, m_pUploadError);
+
+	if (m_pUploadDecoder && !m_pUploadDecoder->IsComplete())
+	{
+		AbortUpload();
+		return WriteUploadError(pBuffer, pLength, "BAD_LZ4");
+	}
+
+	if (!FlushUpload())
+	{
+		AbortUpload();
+		return WriteUploadError(pBuffer, pLength, "FS_WRITE");
+	}
+
+	if (m_bUploadChunked && (m_nChunkCrc ^ 0xFFFFFFFFU) != m_nChunkExpectedCrc)
+	{
+		AbortUpload();
+		return WriteUploadError(pBuffer, pLength, "BAD_CHUNK_CRC");
+	}
+
+	const unsigned sync_start = CTimer::GetClockTicks();
+	f_sync(&m_UploadFile);
+	CountTimed(g_sd_write_metrics, 0, sync_start);
+	f_close(&m_UploadFile);
+	m_bUploadOpen = false;
+
+	const uint32_t committed = m_nUploadOffset + m_nUploadSize;
+	if (m_bUploadChunked && committed < m_nUploadTotal)
+	{
+		snprintf(g_resume_name, sizeof(g_resume_name), "%s", m_UploadName);
+		g_resume_offset = committed;
+		g_resume_crc = m_nUploadCrc;
+
+		char response[256];
+		snprintf(response, sizeof(response),
+			 "{\"ok\":true,\"name\":\"%s\",\"offset\":%u,\"complete\":false}",
+			 m_UploadName, static_cast<unsigned>(committed));
+		return WriteJsonResult(pBuffer, pLength, response);
+	}
+	g_resume_name[0] = '\0';
+	g_resume_offset = 0;
+
+	uint32_t expected_crc = 0;
+	(void) ParseU32(GetHeaderValue("X-CRC32"), &expected_crc);
+	const uint32_t crc = m_nUploadCrc ^ 0xFFFFFFFFU;
+
+	if (committed != m_nUploadTotal)
+	{
+		f_unlink(m_UploadTempPath);
+		return WriteJsonError(pBuffer, pLength, "BAD_SIZE");
+	}
+
+	if (crc != expected_crc)
+	{
+		f_unlink(m_UploadTempPath);
+		return WriteJsonError(pBuffer, pLength, "BAD_CRC");
+	}
+
+	const char *name = m_UploadName;
+	char final_path[256];
+	snprintf(final_path, sizeof(final_path), "%s/%s", kIncomingDir, name);
+
+	f_unlink(final_path);
+	ForgetFileCrc(final_path);
+	if (f_rename(m_UploadTempPath, final_path) != FR_OK)
+	{
+		f_unlink(m_UploadTempPath);
+		return WriteJsonError(pBuffer, pLength, "FS_RENAME");
+	}
+
+	if (!AddPendingUpload(name))
+	{
+		f_unlink(final_path);
+		return WriteJsonError(pBuffer, pLength, "QUEUE_FULL");
+	}
+
+	if (mark_complete)
+	{
+		if (!CommitPendingUploadsTimed(m_IoBuffer, sizeof(m_IoBuffer)))
+			return WriteJsonError(pBuffer, pLength, "FS_COMMIT");
+
+		// Current behavior: successful commit requests teardown automatically.
+		// Future option: keep commit non-rebooting (return {ok:true}) and add an
+		// explicit `POST /teardown` call from the frontend to reboot immediately
+		// after the response is received.
+		CServiceHttpServer::RequestTeardown();
+	}
+
+	char response[256];
+	const char *rebooting = mark_complete ? "true" : "false";
+	snprintf(response, sizeof(response),
+		 "{\"ok\":true,\"name\":\"%s\",\"size\":%u,\"crc32\":\"%08x\",\"offset\":%u,\"complete\":true,\"rebooting\":%s}",
+		 name, static_cast<unsigned>(committed), static_cast<unsigned>(crc), static_cast<unsigned>(committed), rebooting);
+	return WriteJsonResult(pBuffer, pLength, response);
+}
+
+CServiceHttpServer::CServiceHttpServer(CNetSubSystem *pNetSubSystem, CSocket *pSocket)
+	: CHTTPDaemon(pNetSubSystem, pSocket, kMaxContentSize, service_http_port(), 0),
+	  m_pNetSubSystem(pNetSubSystem),
+	  m_bWorker(pSocket != nullptr),
+	  m_nResponseHeadersLength(0),
+	  m_nRouteIndex(-1),
+	  m_nBytesIn(0),
+	  m_nBytesOut(0),
+	  m_bSnapshotAfterResponse(false),
+	  m_bUploadOpen(false),
+	  m_bUploadChunked(false),
+	  m_pUploadError(nullptr),
+	  m_nUploadOffset(0),
+	  m_nUploadTotal(0),
+	  m_nUploadCrc(0),
+	  m_nChunkCrc(0),
+	  m_nChunkExpectedCrc(0),
+	  m_nUploadSize(0),
+	  m_nUploadBuffered(0),
+	  m_pUploadDecoder(nullptr),
+	  m_bResponseFile(false),
+	  m_pResponseEncoder(nullptr),
+	  m_nArchiveCount(0)
+{
+	m_ResponseHeaders[0] = '\0';
+	m_UploadName[0] = '\0';
+	m_UploadTempPath[0] = '\0';
+
+	if (g_nonce == 0)
+	{
+		g_nonce = MakeNonce();
+	}
+}
+
+CServiceHttpServer::~CServiceHttpServer(void)
+{
+	// Connection dropped before the body was complete: discard the partial
+	// file (or, for a chunked upload, the partial chunk).
+	AbortUpload();
+
+	if (m_bResponseFile)
+	{
+		f_close(&m_ResponseFile);
+	}
+
+	delete m_pUploadDecoder;
+	delete m_pResponseEncoder;
+}
+
+void CServiceHttpServer::RequestTeardown(void)
 {
 	g_teardown_requested = true;
 }
@@ -1177,241 +1509,1105 @@ CHTTPDaemon *CServiceHttpServer::CreateWorker(CNetSubSystem *pNetSubSystem, CSoc
 	return new CServiceHttpServer(pNetSubSystem, pSocket);
 }
 
-THTTPStatus CServiceHttpServer::GetContent(const char *pPath,
-					   const char *pParams,
-					   const char *pFormData,
-					   u8 *pBuffer,
-					   unsigned *pLength,
-					   const char **ppContentType)
+void CServiceHttpServer::Run(void)
 {
-	(void) pParams;
-	(void) pFormData;
-
-	if (!pPath || !pBuffer || !pLength || !ppContentType)
-		return HTTPBadRequest;
+	if (!m_bWorker)
+	{
+		CHTTPDaemon::Run();
+		return;
+	}
+	ServeConnection();
+}
 
-	*ppContentType = kMetaContentType;
+static const char *StatusText(THTTPStatus status)
+{
+	switch (static_cast<unsigned>(status))
+	{
+	case 200: return "OK";
+	case 206: return "Partial Content";
+	case 304: return "Not Modified";
+	case 400: return "Bad Request";
+	case 403: return "Forbidden";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 413: return "Request Entity Too Large";
+	case 414: return "Request-URI Too Long";
+	case 416: return "Requested Range Not Satisfiable";
+	case 500: return "Internal Server Error";
+	case 501: return "Not Implemented";
+	default:  return "Error";
+	}
+}
 
-	THTTPRequestMethod method = GetRequestMethod();
+void CServiceHttpServer::AddResponseHeader(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	const size_t cap = sizeof(m_ResponseHeaders) - m_nResponseHeadersLength;
+	const int n = vsnprintf(m_ResponseHeaders + m_nResponseHeadersLength, cap, fmt, args);
+	va_end(args);
 
-	// Root/index aliases accepted by browsers and Circle path normalization.
-	if (pPath[0] == '\0'
-		|| strcmp(pPath, "/") == 0
-		|| strcmp(pPath, "/index.html") == 0
-		|| strcmp(pPath, "/index.html/") == 0
-		|| strcmp(pPath, "index.html") == 0
-		|| strcmp(pPath, "index.html/") == 0)
+	// Drop a field that does not fit (and its partial text) rather than send
+	// a truncated line.
+	if (n < 0 || static_cast<size_t>(n) + 2 >= cap)
 	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
-		*ppContentType = kMetaHtmlType;
-		return WriteTextResult(pBuffer, pLength, s_Index);
+		m_ResponseHeaders[m_nResponseHeadersLength] = '\0';
+		return;
 	}
+	m_nResponseHeadersLength += static_cast<size_t>(n);
+	m_ResponseHeaders[m_nResponseHeadersLength++] = '\r';
+	m_ResponseHeaders[m_nResponseHeadersLength++] = '\n';
+	m_ResponseHeaders[m_nResponseHeadersLength] = '\0';
+}
 
-	if (strcmp(pPath, "/C64_Pro_Mono-STYLE.ttf") == 0 || strcmp(pPath, "/C64_Pro_Mono-STYLE.ttf/") == 0)
+void CServiceHttpServer::SendResponse(THTTPStatus status, const u8 *body, unsigned length, const char *content_type)
+{
+	CSocket *socket = GetConnection();
+	if (!socket)
+		return;
+
+	// An LZ4-encoded body's size is only known once it has been sent; HTTP/1.0
+	// with Connection: close ends it by closing the connection instead.
+	char content_length[32] = "";
+	if (!m_pResponseEncoder)
+		snprintf(content_length, sizeof(content_length), "Content-Length: %u\r\n", length);
+
+	char header[sizeof(m_ResponseHeaders) + 256];
+	const int n = snprintf(header, sizeof(header),
+			       "HTTP/1.0 %u %s\r\n"
+			       "Server: Pi1541\r\n"
+			       "Connection: close\r\n"
+			       "Content-Type: %s\r\n"
+			       "%s"
+			       "%s"
+			       "\r\n",
+			       static_cast<unsigned>(status), StatusText(status),
+			       content_type, content_length, m_ResponseHeaders);
+	if (n < 0 || static_cast<size_t>(n) >= sizeof(header))
+		return;
+	if (!SendData(socket, header, static_cast<unsigned>(n)))
+		return;
+
+	if (GetRequestMethod() == HTTPRequestMethodHead || !length)
+		return;
+
+	if (m_nArchiveCount)
 	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
-		*ppContentType = kMetaFontType;
-		return WriteBinaryResult(pBuffer, pLength, s_Font, sizeof(s_Font));
+		SendArchive(socket);
+		return;
 	}
 
-	if (strcmp(pPath, "/hello") == 0 || strcmp(pPath, "/hello/") == 0)
+	if (!m_bResponseFile)
 	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
+		if (body)
+			SendData(socket, body, length);
+		return;
+	}
 
-		unsigned modified_count = 0;
-		uint32_t modified_id = 0;
-		(void) ReadModifiedListSummary(&modified_count, &modified_id);
+	if (m_pResponseEncoder)
+	{
+		SendFileLz4(socket, length);
+		return;
+	}
 
-		// Keep response shape stable to minimize frontend churn.
-		char response[kJsonSmallResponse];
-		snprintf(response, sizeof(response),
-			 "{\"state\":\"READY\",\"nonce\":%u,\"tcp_port\":%u,\"caps\":[],\"modified_count\":%u,\"modified_id\":%u}",
-			 static_cast<unsigned>(g_nonce),
-			 service_http_port(),
-			 modified_count,
-			 static_cast<unsigned>(modified_id));
-		return WriteJsonResult(pBuffer, pLength, response);
+	// Stream from SD in fixed-size blocks; memory use does not depend on the
+	// file size.
+	while (length)
+	{
+		UINT br = 0;
+		const UINT want = length < sizeof(m_IoBuffer) ? length : sizeof(m_IoBuffer);
+		if (f_read(&m_ResponseFile, m_IoBuffer, want, &br) != FR_OK || br == 0)
+			break;
+		if (!SendData(socket, m_IoBuffer, br))
+			break;
+		length -= br;
 	}
+}
 
-	if (strcmp(pPath, "/modified/list") == 0 || strcmp(pPath, "/modified/list/") == 0)
+// Same flow as CHTTPDaemon's built-in worker (parse, GetContent, respond, log),
+// but the response header is ours, so handlers can add fields to it.
+void CServiceHttpServer::ServeConnection(void)
+{
+	const unsigned start = CTimer::GetClockTicks();
+	m_ResponseHeaders[0] = '\0';
+	m_nResponseHeadersLength = 0;
+	m_nArchiveCount = 0;
+	m_nRouteIndex = -1;
+	m_nBytesIn = 0;
+	m_nBytesOut = 0;
+	m_bSnapshotAfterResponse = false;
+
+	THTTPStatus status = ReadRequest();
+
+	const char *uri = GetRequestURI();
+	char path[kMaxPathLength];
+	snprintf(path, sizeof(path), "%s", uri ? uri : "");
+	const char *params = "";
+	char *query = strchr(path, '?');
+	if (query)
 	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
+		*query++ = '\0';
+		params = query;
+	}
 
-		if (!EnsureModifiedListLoaded())
-			return WriteJsonResult(pBuffer, pLength, "{\"session\":\"\",\"count\":0,\"files\":[]}");
+	unsigned length = 0;
+	u8 *buffer = GetContentBuffer(&length);
+	const char *content_type = kMetaContentType;
+	if (status == HTTPOK)
+	{
+		if (!buffer)
+			status = HTTPInternalServerError;
+		else
+			status = GetContent(path, params, GetRequestFormData(), buffer, &length, &content_type);
+	}
 
-		char *out = reinterpret_cast<char *>(pBuffer);
-		const size_t cap = static_cast<size_t>(*pLength);
-		size_t off = 0;
-		if (!JsonAppend(out, cap, &off, "{\"session\":\"%s\",\"count\":%u,\"files\":[", g_modified_session, g_modified_count))
-			return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
-		for (unsigned i = 0; i < g_modified_count; ++i)
+	if (status == HTTPOK || status == kHTTPPartialContent || status == kHTTPNotModified)
+	{
+		SendResponse(status, buffer, length, content_type);
+	}
+	else
+	{
+		if (m_bResponseFile)
 		{
-			if (i)
-			{
-				if (!JsonAppend(out, cap, &off, ","))
-					return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
-			}
-			if (!JsonAppend(out, cap, &off, "{\"i\":%u,\"name\":\"%s\"}", i + 1, g_modified_display[i]))
-				return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+			f_close(&m_ResponseFile);
+			m_bResponseFile = false;
 		}
-		if (!JsonAppend(out, cap, &off, "]}"))
-			return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
-		*pLength = static_cast<unsigned>(off);
-		return HTTPOK;
+		m_nArchiveCount = 0;
+		delete m_pResponseEncoder;
+		m_pResponseEncoder = nullptr;
+
+		char text[64];
+		snprintf(text, sizeof(text), "%u %s\n", static_cast<unsigned>(status), StatusText(status));
+		length = static_cast<unsigned>(strlen(text));
+		SendResponse(status, reinterpret_cast<const u8 *>(text), length, "text/plain");
 	}
 
-	if (strncmp(pPath, "/modified/download/", 19) == 0)
+	CSocket *socket = GetConnection();
+	if (socket)
 	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
+		CIPAddress foreign_ip(socket->GetForeignIP());
+		WriteAccessLog(foreign_ip, GetRequestMethod(), uri ? uri : "", status, length);
+	}
+	CloseConnection();
 
-		if (!EnsureModifiedListLoaded())
-			return HTTPNotFound;
+	if (m_bResponseFile)
+	{
+		f_close(&m_ResponseFile);
+		m_bResponseFile = false;
+	}
 
-		const char *idx_text = pPath + 19;
-		unsigned idx = static_cast<unsigned>(atoi(idx_text));
-		if (idx == 0 || idx > g_modified_count)
-			return HTTPNotFound;
+	// Latency covers the whole exchange, upload body and SD writes included.
+	TRouteMetrics &metrics = g_route_metrics[m_nRouteIndex >= 0 ? m_nRouteIndex : kRouteMetricsMax - 1];
+	const uint32_t us = CTimer::GetClockTicks() - start;
+	++metrics.count;
+	if (static_cast<unsigned>(status) >= 400)
+		++metrics.errors;
+	metrics.bytes_in += m_nBytesIn;
+	metrics.bytes_out += m_nBytesOut;
+	metrics.total_us += us;
+	if (us > metrics.max_us)
+		metrics.max_us = us;
+	unsigned bucket = 0;
+	for (uint32_t limit = 1000; bucket < kLatencyBuckets - 1 && us > limit; limit *= 4)
+		++bucket;
+	++metrics.buckets[bucket];
+
+	// The UI polls /hello every second: with the answer already sent, copy one
+	// modified disk into the session dir so snapshots build up while idle.
+	if (m_bSnapshotAfterResponse)
+	{
+		m_bSnapshotAfterResponse = false;
+		if (EnsureModifiedListLoaded())
+			SnapshotNextModified(m_IoBuffer, sizeof(m_IoBuffer));
+	}
+}
 
-		const char *file_path = g_modified_cached[idx - 1];
-		if (!file_path || !file_path[0])
-			return HTTPNotFound;
-		if (!IsAllowedModifiedPath(file_path))
-			return HTTPNotFound;
+bool CServiceHttpServer::SendData(CSocket *socket, const void *data, unsigned length)
+{
+	const int sent = socket->Send(data, length, 0);
+	if (sent > 0)
+		m_nBytesOut += static_cast<unsigned>(sent);
+	return sent == static_cast<int>(length);
+}
 
-		FIL fp;
-		if (f_open(&fp, file_path, FA_READ) != FR_OK)
-			return HTTPNotFound;
+// Parses a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range.
+// Returns 1 for a usable range, 0 if there is none or it is not supported (then
+// the whole file is sent), -1 if it lies outside the file.
+static int ParseByteRange(const char *text, uint32_t size, uint32_t *first, uint32_t *last)
+{
+	if (!text || !StartsWithI(text, "bytes="))
+		return 0;
+	text += 6;
+	if (strchr(text, ','))
+		return 0; // multipart/byteranges is not worth it here
+
+	char *end = nullptr;
+	if (*text == '-')
+	{
+		const unsigned long suffix = strtoul(text + 1, &end, 10);
+		if (end == text + 1 || *end)
+			return 0;
+		if (suffix == 0 || size == 0)
+			return -1;
+		*first = suffix >= size ? 0 : size - static_cast<uint32_t>(suffix);
+		*last = size - 1;
+		return 1;
+	}
+
+	const unsigned long from = strtoul(text, &end, 10);
+	if (end == text || *end != '-')
+		return 0;
+	text = end + 1;
+	unsigned long to = size ? size - 1 : 0;
+	if (*text)
+	{
+		to = strtoul(text, &end, 10);
+		if (end == text || *end)
+			return 0;
+	}
+	if (from >= size || to < from)
+		return -1;
+	*first = static_cast<uint32_t>(from);
+	*last = to >= size ? size - 1 : static_cast<uint32_t>(to);
+	return 1;
+}
+
+// CRC32s of recently served files, keyed by path, size and FAT timestamp, so
+// ETag/X-CRC32 and follow-up Range requests do not read the whole file first.
+// Without an RTC every file this kernel writes gets the same timestamp, and
+// D64s all have the same size, so every writer in this kernel (upload
+// finalize, commit, CopyFile) also drops the entries of the paths it replaces.
+// The emulator only writes between service boots, and the cache starts empty
+// on each boot.
+struct TFileCrc
+{
+	char path[kFsPathLength];
+	uint32_t size;
+	uint32_t stamp;		// fdate << 16 | ftime
+	uint32_t crc;
+};
+static constexpr unsigned kFileCrcMax = 8;
+static TFileCrc g_file_crc[kFileCrcMax];
+static unsigned g_file_crc_next = 0;
+
+// path == nullptr forgets every entry.
+static void ForgetFileCrc(const char *path)
+{
+	for (unsigned i = 0; i < kFileCrcMax; ++i)
+	{
+		TFileCrc &entry = g_file_crc[i];
+		if (!path || strcmp(entry.path, path) == 0)
+			entry.path[0] = '\0';
+	}
+}
 
-		const unsigned cap = *pLength;
-		const FSIZE_t sz = f_size(&fp);
-		if (sz > cap)
+static bool FileCrc32(const char *path, const FILINFO &fi, u8 *buffer, unsigned buffer_len, uint32_t *out_crc)
+{
+	const uint32_t size = static_cast<uint32_t>(fi.fsize);
+	const uint32_t stamp = (static_cast<uint32_t>(fi.fdate) << 16) | fi.ftime;
+	for (unsigned i = 0; i < kFileCrcMax; ++i)
+	{
+		const TFileCrc &entry = g_file_crc[i];
+		if (entry.path[0] && entry.size == size && entry.stamp == stamp && strcmp(entry.path, path) == 0)
 		{
-			f_close(&fp);
-			return HTTPRequestEntityTooLarge;
+			*out_crc = entry.crc;
+			return true;
 		}
+	}
+
+	FIL fp;
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return false;
+	uint32_t crc = 0xFFFFFFFFU;
+	UINT br = 0;
+	FRESULT fr;
+	while ((fr = f_read(&fp, buffer, buffer_len, &br)) == FR_OK && br)
+		crc = TimedCrc32Update(crc, buffer, br);
+	f_close(&fp);
+	if (fr != FR_OK)
+		return false;
+	crc ^= 0xFFFFFFFFU;
+
+	TFileCrc &entry = g_file_crc[g_file_crc_next];
+	g_file_crc_next = (g_file_crc_next + 1) % kFileCrcMax;
+	snprintf(entry.path, sizeof(entry.path), "%s", path);
+	entry.size = size;
+	entry.stamp = stamp;
+	entry.crc = crc;
+	*out_crc = crc;
+	return true;
+}
+
+// File download: streamed from SD (SendResponse), with ETag/If-None-Match
+// (size + CRC32), single byte ranges (206) and X-CRC32 of the whole file.
+void CServiceHttpServer::SendFileLz4(CSocket *socket, unsigned length)
+{
+	unsigned n = 0;
+	const u8 *out = m_pResponseEncoder->Begin(&n);
+	if (!SendData(socket, out, n))
+		return;
+
+	u8 *in = m_pResponseEncoder->GetInputBuffer();
+	while (length)
+	{
 		UINT br = 0;
-		FRESULT fr = f_read(&fp, pBuffer, cap, &br);
-		f_close(&fp);
-		if (fr != FR_OK)
-			return HTTPInternalServerError;
+		const UINT want = length < CLz4FrameEncoder::BlockSize ? length : CLz4FrameEncoder::BlockSize;
+		if (f_read(&m_ResponseFile, in, want, &br) != FR_OK || br == 0)
+			return; // no EndMark: the client sees a truncated frame
+		out = m_pResponseEncoder->Block(br, &n);
+		if (!SendData(socket, out, n))
+			return;
+		length -= br;
+	}
 
-		*ppContentType = "application/octet-stream";
-		*pLength = br;
-		return HTTPOK;
+	out = m_pResponseEncoder->End(&n);
+	SendData(socket, out, n);
+}
+
+// Token in a comma separated header list such as Accept-Encoding.
+static bool HasToken(const char *list, const char *token)
+{
+	const size_t n = strlen(token);
+	for (const char *p = list; p && *p; )
+	{
+		while (*p == ' ' || *p == ',')
+			++p;
+		if (StartsWithI(p, token) && (p[n] == '\0' || p[n] == ',' || p[n] == ' ' || p[n] == ';'))
+			return true;
+		p = strchr(p, ',');
 	}
+	return false;
+}
 
-	if (strcmp(pPath, "/upload/active") == 0 || strcmp(pPath, "/upload/active/") == 0)
+// "encoding=lz4" in the query (fetch() cannot set Accept-Encoding), or an
+// "lz4" token in Accept-Encoding.
+static bool WantsLz4(const char *accept_encoding, const char *params)
+{
+	for (const char *p = params; p && *p; )
 	{
-		if (method != HTTPRequestMethodPut && method != HTTPRequestMethodPost)
-			return HTTPMethodNotImplemented;
-		return HandleUpload(pBuffer, pLength, false, true);
+		const char *end = strchr(p, '&');
+		const size_t n = end ? static_cast<size_t>(end - p) : strlen(p);
+		if (n == 12 && strncmp(p, "encoding=lz4", 12) == 0)
+			return true;
+		p = end ? end + 1 : nullptr;
 	}
+	return HasToken(accept_encoding, "lz4");
+}
 
-	if (strcmp(pPath, "/upload/active/add") == 0 || strcmp(pPath, "/upload/active/add/") == 0)
+// Embedded UI asset: the gzip copy when the client takes it, an ETag from the
+// CRC32 of the plain bytes (computed once per asset), 304 on revalidation.
+THTTPStatus CServiceHttpServer::ServeStatic(const u8 *data, unsigned size, const u8 *gz, unsigned gz_size,
+					    uint32_t *pCrc, const char *cache_control, u8 *pBuffer, unsigned *pLength)
+{
+	if (*pCrc == 0)
+		*pCrc = TimedCrc32Update(0xFFFFFFFFU, data, size) ^ 0xFFFFFFFFU;
+
+	const bool gzip = HasToken(GetHeaderValue("Accept-Encoding"), "gzip");
+	char etag[24];
+	snprintf(etag, sizeof(etag), "\"%08x%s\"", static_cast<unsigned>(*pCrc), gzip ? "-gz" : "");
+	AddResponseHeader("ETag: %s", etag);
+	AddResponseHeader("Cache-Control: %s", cache_control);
+	AddResponseHeader("Vary: Accept-Encoding");
+
+	const char *if_none_match = GetHeaderValue("If-None-Match");
+	if (if_none_match && strstr(if_none_match, etag))
 	{
-		if (method != HTTPRequestMethodPut && method != HTTPRequestMethodPost)
-			return HTTPMethodNotImplemented;
-		return HandleUpload(pBuffer, pLength, true, false);
+		*pLength = 0;
+		return kHTTPNotModified;
 	}
 
-	if (strcmp(pPath, "/upload/active/commit") == 0 || strcmp(pPath, "/upload/active/commit/") == 0)
+	if (!gzip)
+		return WriteBinaryResult(pBuffer, pLength, data, size);
+	AddResponseHeader("Content-Encoding: gzip");
+	return WriteBinaryResult(pBuffer, pLength, gz, gz_size);
+}
+
+THTTPStatus CServiceHttpServer::ServeFile(const char *path, bool lz4, unsigned *pLength, const char **ppContentType)
+{
+	FILINFO fi;
+	if (f_stat(path, &fi) != FR_OK || (fi.fattrib & AM_DIR))
+		return HTTPNotFound;
+
+	const uint32_t size = static_cast<uint32_t>(fi.fsize);
+	uint32_t crc = 0;
+	if (!FileCrc32(path, fi, m_IoBuffer, sizeof(m_IoBuffer), &crc))
+		return HTTPInternalServerError;
+
+	// The encoded body is a different representation, so it has its own ETag.
+	char etag[32];
+	snprintf(etag, sizeof(etag), "\"%08x-%08x%s\"", static_cast<unsigned>(size), static_cast<unsigned>(crc), lz4 ? "-lz4" : "");
+	AddResponseHeader("ETag: %s", etag);
+	AddResponseHeader("Accept-Ranges: %s", lz4 ? "none" : "bytes");
+	AddResponseHeader("Vary: Accept-Encoding");
+	AddResponseHeader("X-CRC32: 0x%08x", static_cast<unsigned>(crc));
+	*ppContentType = "application/octet-stream";
+
+	const char *if_none_match = GetHeaderValue("If-None-Match");
+	if (if_none_match && (strstr(if_none_match, etag) || strcmp(if_none_match, "*") == 0))
 	{
-		if (method != HTTPRequestMethodPost)
-			return HTTPMethodNotImplemented;
+		*pLength = 0;
+		return kHTTPNotModified;
+	}
 
-		const char *nonce_text = GetHeaderValue("X-Nonce");
-		uint32_t nonce = 0;
-		if (!ParseU32(nonce_text, &nonce) || nonce != g_nonce)
-			return WriteJsonError(pBuffer, pLength, "BAD_NONCE");
+	uint32_t first = 0;
+	uint32_t last = 0;
+	int range = lz4 ? 0 : ParseByteRange(GetHeaderValue("Range"), size, &first, &last);
+	const char *if_range = GetHeaderValue("If-Range");
+	if (range && if_range && if_range[0] && strcmp(if_range, etag) != 0)
+		range = 0; // file changed since the client's partial copy: send all of it
+	if (range < 0)
+	{
+		AddResponseHeader("Content-Range: bytes */%u", static_cast<unsigned>(size));
+		*pLength = 0;
+		return kHTTPRangeNotSatisfiable;
+	}
 
-		if (g_pending_count == 0)
-			return WriteJsonError(pBuffer, pLength, "NO_FILES");
+	if (f_open(&m_ResponseFile, path, FA_READ) != FR_OK)
+		return HTTPNotFound;
+	m_bResponseFile = true;
 
-		if (!CommitPendingUploads())
-			return WriteJsonError(pBuffer, pLength, "FS_COMMIT");
+	if (lz4)
+	{
+		m_pResponseEncoder = new CLz4FrameEncoder;
+		if (!m_pResponseEncoder || !m_pResponseEncoder->Initialize())
+			return HTTPInternalServerError;
+		AddResponseHeader("Content-Encoding: lz4");
+	}
 
-		// See note above: commit currently requests teardown automatically.
-		CServiceHttpServer::RequestTeardown();
-		return WriteJsonResult(pBuffer, pLength, "{\"ok\":true,\"committed\":true,\"rebooting\":true}");
+	if (range == 0)
+	{
+		*pLength = size;
+		return HTTPOK;
+	}
+
+	if (f_lseek(&m_ResponseFile, first) != FR_OK)
+		return HTTPInternalServerError;
+	AddResponseHeader("Content-Range: bytes %u-%u/%u",
+			  static_cast<unsigned>(first), static_cast<unsigned>(last), static_cast<unsigned>(size));
+	*pLength = last - first + 1;
+	return kHTTPPartialContent;
+}
+
+// The tar archive (ustar) of GET /modified/archive is generated while it is
+// sent: a 512-byte header, the file padded to 512 bytes, and two zero blocks at
+// the end. Its length is known up front, so it goes out with Content-Length.
+static constexpr unsigned kTarBlock = 512;
+
+static uint32_t TarPadded(uint32_t size)
+{
+	return (size + kTarBlock - 1) & ~(kTarBlock - 1);
+}
+
+// FAT date/time (local, 2 s resolution) to seconds since 1970.
+static uint32_t FatTimeToUnix(WORD fdate, WORD ftime)
+{
+	static const unsigned short days_before[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+	const unsigned year = 1980 + (fdate >> 9);
+	unsigned month = (fdate >> 5) & 15;
+	const unsigned day = fdate & 31;
+	if (month < 1 || month > 12 || day < 1)
+		return 0;
+	--month;
+
+	uint32_t days = (year - 1970) * 365 + (year - 1969) / 4 + days_before[month] + day - 1;
+	if (month >= 2 && (year % 4) == 0)
+		++days; // 1980-2107: every fourth year is a leap year except 2100
+	if (year > 2100 || (year == 2100 && month >= 2))
+		--days;
+	return days * 86400U + (ftime >> 11) * 3600U + ((ftime >> 5) & 63) * 60U + (ftime & 31) * 2U;
+}
+
+static void TarHeader(u8 *block, const char *name, uint32_t size, uint32_t mtime)
+{
+	memset(block, 0, kTarBlock);
+	snprintf(reinterpret_cast<char *>(block), 100, "%s", name);
+	snprintf(reinterpret_cast<char *>(block + 100), 8, "%07o", 0644U);
+	snprintf(reinterpret_cast<char *>(block + 108), 8, "%07o", 0U);
+	snprintf(reinterpret_cast<char *>(block + 116), 8, "%07o", 0U);
+	snprintf(reinterpret_cast<char *>(block + 124), 12, "%011lo", static_cast<unsigned long>(size));
+	snprintf(reinterpret_cast<char *>(block + 136), 12, "%011lo", static_cast<unsigned long>(mtime));
+	block[156] = '0';
+	memcpy(block + 257, "ustar", 6);
+	memcpy(block + 263, "00", 2);
+
+	memset(block + 148, ' ', 8);
+	unsigned sum = 0;
+	for (unsigned i = 0; i < kTarBlock; ++i)
+		sum += block[i];
+	snprintf(reinterpret_cast<char *>(block + 148), 8, "%06o", sum);
+	block[155] = ' ';
+}
+
+// Names inside the archive match the dirty snapshot copies: "NN_<name>".
+static void ArchiveEntryName(unsigned index, char *out, size_t out_len)
+{
+	char safe[64];
+	SanitizeFilename(g_modified_display[index], safe, sizeof(safe));
+	if (!safe[0])
+		snprintf(safe, sizeof(safe), "disk_%u.bin", index + 1);
+	snprintf(out, out_len, "%02u_%s", index + 1, safe);
+}
+
+// Takes the session dir copy of modified disk 'index' if it is still pending.
+// A copy already there with the same size and CRC32 (the list was re-read in
+// the same session) is reused instead of written again. On failure downloads
+// keep reading the original in _active_mount/.
+static bool SnapshotModified(unsigned index, u8 *buffer, unsigned buffer_len)
+{
+	if (index >= g_modified_count || !g_modified_pending[index])
+		return true;
+	g_modified_pending[index] = false;
+
+	char name[100];
+	ArchiveEntryName(index, name, sizeof(name));
+	char dst[256];
+	snprintf(dst, sizeof(dst), "%s/%s/%s", kTempDirtyDir, g_modified_session, name);
+
+	const char *src = g_modified_cached[index];
+	FILINFO src_fi, dst_fi;
+	if (f_stat(src, &src_fi) != FR_OK)
+		return false;
+
+	uint32_t src_crc = 0, dst_crc = 1;
+	const bool same = f_stat(dst, &dst_fi) == FR_OK && dst_fi.fsize == src_fi.fsize &&
+			  FileCrc32(src, src_fi, buffer, buffer_len, &src_crc) &&
+			  FileCrc32(dst, dst_fi, buffer, buffer_len, &dst_crc) && src_crc == dst_crc;
+	if (!same && !CopyFile(src, dst))
+		return false;
+
+	snprintf(g_modified_cached[index], sizeof(g_modified_cached[index]), "%s", dst);
+	return true;
+}
+
+// Before _active_mount/ is cleared: every disk of this session that is not
+// yet in the session dir, pending or after a failed copy, is copied now.
+// False if one of them still only exists in _active_mount/.
+static bool SnapshotAllModified(u8 *buffer, unsigned buffer_len)
+{
+	if (!g_modified_session[0])
+		return true;
+
+	for (unsigned i = 0; i < g_modified_count; ++i)
+	{
+		if (!StartsWithDir(g_modified_cached[i], kActiveMountDir))
+			continue;
+		g_modified_pending[i] = true;
+		if (!SnapshotModified(i, buffer, buffer_len))
+			return false;
 	}
+	return true;
+}
 
-	if (strcmp(pPath, "/active/list") == 0 || strcmp(pPath, "/active/list/") == 0)
+// Background snapshotting: one pending disk per call.
+static void SnapshotNextModified(u8 *buffer, unsigned buffer_len)
+{
+	for (unsigned i = 0; i < g_modified_count; ++i)
 	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
+		if (g_modified_pending[i])
+		{
+			SnapshotModified(i, buffer, buffer_len);
+			return;
+		}
+	}
+}
 
-		static char names[kPendingMax][64];
-		unsigned count = 0;
-		if (!ReadActiveList(names, count) || count == 0)
-			return WriteJsonResult(pBuffer, pLength, "{\"count\":0,\"files\":[]}");
+THTTPStatus CServiceHttpServer::ServeArchive(unsigned *pLength, const char **ppContentType)
+{
+	const unsigned count = g_modified_count < kArchiveMax ? g_modified_count : kArchiveMax;
+	uint32_t total = 2 * kTarBlock;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const char *file_path = g_modified_cached[i];
+		FILINFO fi;
+		if (!file_path[0] || !IsAllowedModifiedPath(file_path) ||
+		    f_stat(file_path, &fi) != FR_OK || (fi.fattrib & AM_DIR))
+			return HTTPNotFound;
 
-		char *out = reinterpret_cast<char *>(pBuffer);
-		const size_t cap = static_cast<size_t>(*pLength);
-		size_t off = 0;
-		if (!JsonAppend(out, cap, &off, "{\"count\":%u,\"files\":[", count))
-			return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
-		for (unsigned i = 0; i < count; ++i)
+		m_ArchiveSize[i] = static_cast<uint32_t>(fi.fsize);
+		m_ArchiveTime[i] = FatTimeToUnix(fi.fdate, fi.ftime);
+		total += kTarBlock + TarPadded(m_ArchiveSize[i]);
+	}
+	m_nArchiveCount = count;
+
+	AddResponseHeader("Content-Disposition: attachment; filename=\"%s.tar\"",
+			  g_modified_session[0] ? g_modified_session : "modified");
+	*ppContentType = "application/x-tar";
+	*pLength = total;
+	return HTTPOK;
+}
+
+// Streams exactly the length ServeArchive() announced: a file that changed
+// size since then is cut or zero-filled to its announced size.
+void CServiceHttpServer::SendArchive(CSocket *socket)
+{
+	for (unsigned i = 0; i < m_nArchiveCount; ++i)
+	{
+		char name[100];
+		ArchiveEntryName(i, name, sizeof(name));
+		TarHeader(m_IoBuffer, name, m_ArchiveSize[i], m_ArchiveTime[i]);
+		if (!SendData(socket, m_IoBuffer, kTarBlock))
+			return;
+
+		FIL fp;
+		const bool open = f_open(&fp, g_modified_cached[i], FA_READ) == FR_OK;
+		uint32_t left = TarPadded(m_ArchiveSize[i]);
+		uint32_t data = m_ArchiveSize[i];
+		while (left)
 		{
-			if (i)
+			const UINT want = left < sizeof(m_IoBuffer) ? left : sizeof(m_IoBuffer);
+			UINT br = 0;
+			if (open && data)
+			{
+				const UINT from_file = data < want ? data : want;
+				if (f_read(&fp, m_IoBuffer, from_file, &br) != FR_OK)
+					br = 0;
+				data -= from_file;
+			}
+			memset(m_IoBuffer + br, 0, want - br);
+			if (!SendData(socket, m_IoBuffer, want))
 			{
-				if (!JsonAppend(out, cap, &off, ","))
-					return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+				if (open)
+					f_close(&fp);
+				return;
 			}
-			if (!JsonAppend(out, cap, &off, "{\"i\":%u,\"name\":\"%s\"}", i + 1, names[i]))
+			left -= want;
+		}
+		if (open)
+			f_close(&fp);
+	}
+
+	memset(m_IoBuffer, 0, 2 * kTarBlock);
+	SendData(socket, m_IoBuffer, 2 * kTarBlock);
+}
+
+// Keep sorted by path (strcmp order): FindRoute() is a binary search.
+const CServiceHttpServer::TRoute CServiceHttpServer::s_Routes[] =
+{
+	{ "/",				kMethodGet,			0,			&CServiceHttpServer::RouteIndex },
+	{ "/C64_Pro_Mono-STYLE.ttf",	kMethodGet,			0,			&CServiceHttpServer::RouteFont },
+	{ "/active/download",		kMethodGet,			kRoutePrefix,		&CServiceHttpServer::RouteActiveDownload },
+	{ "/active/list",		kMethodGet,			0,			&CServiceHttpServer::RouteActiveList },
+	{ "/boottime",			kMethodGet,			0,			&CServiceHttpServer::RouteBootTime },
+	{ "/hello",			kMethodGet,			0,			&CServiceHttpServer::RouteHello },
+	{ "/index.html",		kMethodGet,			0,			&CServiceHttpServer::RouteIndex },
+	{ "/metrics",			kMethodGet,			0,			&CServiceHttpServer::RouteMetrics },
+	{ "/modified/archive",		kMethodGet | kMethodHead,	0,			&CServiceHttpServer::RouteModifiedArchive },
+	{ "/modified/download",		kMethodGet,			kRoutePrefix,		&CServiceHttpServer::RouteModifiedDownload },
+	{ "/modified/list",		kMethodGet,			0,			&CServiceHttpServer::RouteModifiedList },
+	{ "/upload/active",		kMethodGet | kMethodUpload,	kRouteUploadBody,	&CServiceHttpServer::RouteUpload },
+	{ "/upload/active/add",		kMethodGet | kMethodUpload,	kRouteUploadBody | kRouteAppend, &CServiceHttpServer::RouteUpload },
+	{ "/upload/active/commit",	kMethodPost,			kRouteNonce,		&CServiceHttpServer::RouteUploadCommit },
+};
+
+const CServiceHttpServer::TRoute *CServiceHttpServer::SearchRoutes(const char *pPath)
+{
+	unsigned low = 0;
+	unsigned high = sizeof(s_Routes) / sizeof(s_Routes[0]);
+	while (low < high)
+	{
+		const unsigned mid = (low + high) / 2;
+		const int cmp = strcmp(pPath, s_Routes[mid].pPath);
+		if (cmp == 0)
+			return &s_Routes[mid];
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return nullptr;
+}
+
+// Normalizes pURI into pPath (query dropped, leading '/' added, trailing '/'
+// removed) and looks it up. A prefix route also matches "<route>/<arg>";
+// *ppArg is then "<arg>", otherwise "".
+const CServiceHttpServer::TRoute *CServiceHttpServer::FindRoute(const char *pURI, char *pPath, size_t nPathSize, const char **ppArg)
+{
+	*ppArg = "";
+	if (!pURI || nPathSize < 2)
+		return nullptr;
+
+	size_t n = strcspn(pURI, "?");
+	const bool slash = pURI[0] == '/';
+	if (n + (slash ? 0 : 1) >= nPathSize)
+		return nullptr;
+	pPath[0] = '/';
+	memcpy(pPath + (slash ? 0 : 1), pURI, n);
+	n += slash ? 0 : 1;
+	while (n > 1 && pPath[n - 1] == '/')
+		--n;
+	pPath[n] = '\0';
+
+	const TRoute *route = SearchRoutes(pPath);
+	if (route)
+		return route;
+
+	// "/modified/download/3/NAME.D64" -> "/modified/download" + "3/NAME.D64"
+	for (char *cut = pPath + n - 1; cut > pPath; --cut)
+	{
+		if (*cut != '/')
+			continue;
+		*cut = '\0';
+		route = SearchRoutes(pPath);
+		if (route)
+		{
+			if (!(route->nFlags & kRoutePrefix))
+				return nullptr;
+			*ppArg = cut + 1;
+			return route;
+		}
+		*cut = '/';
+	}
+	return nullptr;
+}
+
+THTTPStatus CServiceHttpServer::GetContent(const char *pPath,
+					   const char *pParams,
+					   const char *pFormData,
+					   u8 *pBuffer,
+					   unsigned *pLength,
+					   const char **ppContentType)
+{
+	(void) pFormData;
+
+	if (!pPath || !pBuffer || !pLength || !ppContentType)
+		return HTTPBadRequest;
+
+	*ppContentType = kMetaContentType;
+
+	char path[kMaxPathLength];
+	const char *arg = nullptr;
+	const TRoute *route = FindRoute(pPath, path, sizeof(path), &arg);
+	if (!route)
+		return HTTPNotFound;
+
+	m_nRouteIndex = static_cast<int>(route - s_Routes);
+
+	// A method this server has no handling for at all stays 501; a known
+	// one the route does not take is 405 with the methods it does.
+	const THTTPRequestMethod method = GetRequestMethod();
+	if (method == HTTPRequestMethodUnknown)
+		return HTTPMethodNotImplemented;
+	if (!(route->nMethods & MethodBit(method)))
+	{
+		char allow[32];
+		FormatMethods(route->nMethods, allow, sizeof(allow));
+		AddResponseHeader("Allow: %s", allow);
+		return kHTTPMethodNotAllowed;
+	}
+
+	if (route->nFlags & kRouteNonce)
+	{
+		uint32_t nonce = 0;
+		if (!ParseU32(GetHeaderValue("X-Nonce"), &nonce) || nonce != g_nonce)
+			return WriteJsonError(pBuffer, pLength, "BAD_NONCE");
+	}
+
+	const TRouteRequest request = { route, method, arg, pParams ? pParams : "", pBuffer, pLength, ppContentType };
+	return (this->*route->Handler)(request);
+}
+
+THTTPStatus CServiceHttpServer::RouteIndex(const TRouteRequest &rRequest)
+{
+	*rRequest.ppContentType = kMetaHtmlType;
+	// Unversioned URL: revalidate every load (a 304 is a few bytes).
+	static uint32_t crc = 0;
+	return ServeStatic(reinterpret_cast<const u8 *>(s_Index), sizeof(s_Index) - 1, s_IndexGz, sizeof(s_IndexGz),
+			   &crc, "no-cache", rRequest.pBuffer, rRequest.pLength);
+}
+
+THTTPStatus CServiceHttpServer::RouteFont(const TRouteRequest &rRequest)
+{
+	*rRequest.ppContentType = kMetaFontType;
+	// The font is pinned by vendors/style64-font.lock and does not change.
+	static uint32_t crc = 0;
+	return ServeStatic(s_Font, sizeof(s_Font), s_FontGz, sizeof(s_FontGz),
+			   &crc, "public, max-age=31536000, immutable", rRequest.pBuffer, rRequest.pLength);
+}
+
+THTTPStatus CServiceHttpServer::RouteHello(const TRouteRequest &rRequest)
+{
+	unsigned modified_count = 0;
+	uint32_t modified_id = 0;
+	(void) ReadModifiedListSummary(&modified_count, &modified_id);
+	m_bSnapshotAfterResponse = modified_count != 0;
+
+	// Keep response shape stable to minimize frontend churn.
+	char response[kJsonSmallResponse];
+	snprintf(response, sizeof(response),
+		 "{\"state\":\"READY\",\"nonce\":%u,\"tcp_port\":%u,\"caps\":[],\"modified_count\":%u,\"modified_id\":%u}",
+		 static_cast<unsigned>(g_nonce),
+		 service_http_port(),
+		 modified_count,
+		 static_cast<unsigned>(modified_id));
+	return WriteJsonResult(rRequest.pBuffer, rRequest.pLength, response);
+}
+
+THTTPStatus CServiceHttpServer::RouteModifiedList(const TRouteRequest &rRequest)
+{
+	u8 *pBuffer = rRequest.pBuffer;
+	unsigned *pLength = rRequest.pLength;
+
+	if (!EnsureModifiedListLoaded())
+		return WriteJsonResult(pBuffer, pLength, "{\"session\":\"\",\"count\":0,\"files\":[]}");
+
+	char *out = reinterpret_cast<char *>(pBuffer);
+	const size_t cap = static_cast<size_t>(*pLength);
+	size_t off = 0;
+	if (!JsonAppend(out, cap, &off, "{\"session\":\"%s\",\"count\":%u,\"files\":[", g_modified_session, g_modified_count))
+		return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+	for (unsigned i = 0; i < g_modified_count; ++i)
+	{
+		if (i)
+		{
+			if (!JsonAppend(out, cap, &off, ","))
 				return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
 		}
-		if (!JsonAppend(out, cap, &off, "]}"))
+		if (!JsonAppend(out, cap, &off, "{\"i\":%u,\"name\":\"%s\"}", i + 1, g_modified_display[i]))
 			return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
-		*pLength = static_cast<unsigned>(off);
-		return HTTPOK;
 	}
+	if (!JsonAppend(out, cap, &off, "]}"))
+		return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+	*pLength = static_cast<unsigned>(off);
+	return HTTPOK;
+}
 
-	if (strncmp(pPath, "/active/download/", 17) == 0)
-	{
-		if (method != HTTPRequestMethodGet)
-			return HTTPMethodNotImplemented;
+THTTPStatus CServiceHttpServer::RouteModifiedArchive(const TRouteRequest &rRequest)
+{
+	if (!EnsureModifiedListLoaded())
+		return HTTPNotFound;
 
-		static char names[kPendingMax][64];
-		unsigned count = 0;
-		if (!ReadActiveList(names, count) || count == 0)
-			return HTTPNotFound;
+	return ServeArchive(rRequest.pLength, rRequest.ppContentType);
+}
 
-		const char *idx_text = pPath + 17;
-		unsigned idx = static_cast<unsigned>(atoi(idx_text));
-		if (idx == 0 || idx > count)
-			return HTTPNotFound;
-		if (!IsSafeLeafName(names[idx - 1]))
-			return HTTPNotFound;
+THTTPStatus CServiceHttpServer::RouteModifiedDownload(const TRouteRequest &rRequest)
+{
+	if (!EnsureModifiedListLoaded())
+		return HTTPNotFound;
+
+	unsigned idx = static_cast<unsigned>(atoi(rRequest.pArg));
+	if (idx == 0 || idx > g_modified_count)
+		return HTTPNotFound;
+
+	SnapshotModified(idx - 1, m_IoBuffer, sizeof(m_IoBuffer));
+	const char *file_path = g_modified_cached[idx - 1];
+	if (!file_path || !file_path[0])
+		return HTTPNotFound;
+	if (!IsAllowedModifiedPath(file_path))
+		return HTTPNotFound;
+
+	return ServeFile(file_path, WantsLz4(GetHeaderValue("Accept-Encoding"), rRequest.pParams),
+			 rRequest.pLength, rRequest.ppContentType);
+}
 
-		char path[kFsPathLength];
-		snprintf(path, sizeof(path), "%s/%s", kActiveMountDir, names[idx - 1]);
-		FIL fp;
-		if (f_open(&fp, path, FA_READ) != FR_OK)
-			return HTTPNotFound;
+THTTPStatus CServiceHttpServer::RouteUpload(const TRouteRequest &rRequest)
+{
+	const bool append_list = (rRequest.pRoute->nFlags & kRouteAppend) != 0;
+	if (rRequest.Method == HTTPRequestMethodGet)
+		return HandleUploadOffset(rRequest.pBuffer, rRequest.pLength, append_list);
+	return HandleUpload(rRequest.pBuffer, rRequest.pLength, append_list, !append_list);
+}
 
-		const unsigned cap = *pLength;
-		const FSIZE_t sz = f_size(&fp);
-		if (sz > cap)
+THTTPStatus CServiceHttpServer::RouteUploadCommit(const TRouteRequest &rRequest)
+{
+	if (g_pending_count == 0)
+		return WriteJsonError(rRequest.pBuffer, rRequest.pLength, "NO_FILES");
+
+	if (!CommitPendingUploadsTimed(m_IoBuffer, sizeof(m_IoBuffer)))
+		return WriteJsonError(rRequest.pBuffer, rRequest.pLength, "FS_COMMIT");
+
+	// See note in HandleUpload(): commit currently requests teardown automatically.
+	CServiceHttpServer::RequestTeardown();
+	return WriteJsonResult(rRequest.pBuffer, rRequest.pLength, "{\"ok\":true,\"committed\":true,\"rebooting\":true}");
+}
+
+THTTPStatus CServiceHttpServer::RouteActiveList(const TRouteRequest &rRequest)
+{
+	u8 *pBuffer = rRequest.pBuffer;
+	unsigned *pLength = rRequest.pLength;
+
+	static char names[kPendingMax][64];
+	unsigned count = 0;
+	if (!ReadActiveList(names, count) || count == 0)
+		return WriteJsonResult(pBuffer, pLength, "{\"count\":0,\"files\":[]}");
+
+	char *out = reinterpret_cast<char *>(pBuffer);
+	const size_t cap = static_cast<size_t>(*pLength);
+	size_t off = 0;
+	if (!JsonAppend(out, cap, &off, "{\"count\":%u,\"files\":[", count))
+		return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+	for (unsigned i = 0; i < count; ++i)
+	{
+		if (i)
 		{
-			f_close(&fp);
-			return HTTPRequestEntityTooLarge;
+			if (!JsonAppend(out, cap, &off, ","))
+				return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
 		}
-		UINT br = 0;
-		FRESULT fr = f_read(&fp, pBuffer, cap, &br);
-		f_close(&fp);
-		if (fr != FR_OK)
-			return HTTPInternalServerError;
+		if (!JsonAppend(out, cap, &off, "{\"i\":%u,\"name\":\"%s\"}", i + 1, names[i]))
+			return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+	}
+	if (!JsonAppend(out, cap, &off, "]}"))
+		return WriteJsonError(pBuffer, pLength, "RESP_TOO_LARGE");
+	*pLength = static_cast<unsigned>(off);
+	return HTTPOK;
+}
+
+THTTPStatus CServiceHttpServer::RouteActiveDownload(const TRouteRequest &rRequest)
+{
+	static char names[kPendingMax][64];
+	unsigned count = 0;
+	if (!ReadActiveList(names, count) || count == 0)
+		return HTTPNotFound;
+
+	unsigned idx = static_cast<unsigned>(atoi(rRequest.pArg));
+	if (idx == 0 || idx > count)
+		return HTTPNotFound;
+	if (!IsSafeLeafName(names[idx - 1]))
+		return HTTPNotFound;
+
+	char path[kFsPathLength];
+	snprintf(path, sizeof(path), "%s/%s", kActiveMountDir, names[idx - 1]);
+	return ServeFile(path, WantsLz4(GetHeaderValue("Accept-Encoding"), rRequest.pParams),
+			 rRequest.pLength, rRequest.ppContentType);
+}
+
+// Counters since the service kernel started: JSON by default, Prometheus text
+// exposition with ?format=prometheus.
+THTTPStatus CServiceHttpServer::RouteMetrics(const TRouteRequest &rRequest)
+{
+	char *out = reinterpret_cast<char *>(rRequest.pBuffer);
+	const size_t cap = static_cast<size_t>(*rRequest.pLength);
+	size_t off = 0;
+	const unsigned routes = sizeof(s_Routes) / sizeof(s_Routes[0]);
+	static_assert(sizeof(s_Routes) / sizeof(s_Routes[0]) < kRouteMetricsMax, "one metrics slot per route, plus one");
+	const unsigned uptime = CTimer::Get()->GetUptime();
+	const bool prometheus = strstr(rRequest.pParams, "format=prometheus") != nullptr;
+
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	for (unsigned i = 0; i < kRouteMetricsMax; ++i)
+	{
+		bytes_in += g_route_metrics[i].bytes_in;
+		bytes_out += g_route_metrics[i].bytes_out;
+	}
+	// KB/s == bytes per ms
+	const TTimedMetrics &sd = g_sd_write_metrics;
+	const unsigned sd_kbps = sd.total_us ? static_cast<unsigned>(sd.bytes * 1000 / sd.total_us) : 0;
+	const unsigned crc_kbps = g_crc_metrics.total_us ? static_cast<unsigned>(g_crc_metrics.bytes * 1000 / g_crc_metrics.total_us) : 0;
 
-		*ppContentType = "application/octet-stream";
-		*pLength = br;
+	if (prometheus)
+	{
+		bool ok = JsonAppend(out, cap, &off,
+			"# TYPE pi1541_uptime_seconds gauge\npi1541_uptime_seconds %u\n"
+			"# TYPE pi1541_http_bytes_in_total counter\npi1541_http_bytes_in_total %llu\n"
+			"# TYPE pi1541_http_bytes_out_total counter\npi1541_http_bytes_out_total %llu\n"
+			"# TYPE pi1541_sd_write_bytes_total counter\npi1541_sd_write_bytes_total %llu\n"
+			"# TYPE pi1541_sd_write_seconds_total counter\npi1541_sd_write_seconds_total %llu.%06llu\n"
+			"# TYPE pi1541_crc_bytes_total counter\npi1541_crc_bytes_total %llu\n"
+			"# TYPE pi1541_crc_seconds_total counter\npi1541_crc_seconds_total %llu.%06llu\n"
+			"# TYPE pi1541_commit_total counter\npi1541_commit_total %u\n"
+			"# TYPE pi1541_commit_seconds_total counter\npi1541_commit_seconds_total %llu.%06llu\n"
+			"# TYPE pi1541_http_request_duration_seconds histogram\n",
+			uptime,
+			static_cast<unsigned long long>(bytes_in), static_cast<unsigned long long>(bytes_out),
+			static_cast<unsigned long long>(sd.bytes),
+			static_cast<unsigned long long>(sd.total_us / 1000000), static_cast<unsigned long long>(sd.total_us % 1000000),
+			static_cast<unsigned long long>(g_crc_metrics.bytes),
+			static_cast<unsigned long long>(g_crc_metrics.total_us / 1000000), static_cast<unsigned long long>(g_crc_metrics.total_us % 1000000),
+			g_commit_metrics.count,
+			static_cast<unsigned long long>(g_commit_metrics.total_us / 1000000), static_cast<unsigned long long>(g_commit_metrics.total_us % 1000000));
+		for (unsigned i = 0; ok && i <= routes; ++i)
+		{
+			const TRouteMetrics &m = g_route_metrics[i < routes ? i : kRouteMetricsMax - 1];
+			if (!m.count)
+				continue;
+			const char *path = i < routes ? s_Routes[i].pPath : "other";
+			uint32_t cumulative = 0;
+			uint32_t limit_ms = 1;
+			for (unsigned b = 0; ok && b < kLatencyBuckets - 1; ++b, limit_ms *= 4)
+			{
+				cumulative += m.buckets[b];
+				ok = JsonAppend(out, cap, &off, "pi1541_http_request_duration_seconds_bucket{route=\"%s\",le=\"%u.%03u\"} %u\n",
+						path, limit_ms / 1000, limit_ms % 1000, cumulative);
+			}
+			ok = ok && JsonAppend(out, cap, &off,
+				"pi1541_http_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %u\n"
+				"pi1541_http_request_duration_seconds_sum{route=\"%s\"} %llu.%06llu\n"
+				"pi1541_http_request_duration_seconds_count{route=\"%s\"} %u\n"
+				"pi1541_http_request_errors_total{route=\"%s\"} %u\n",
+				path, m.count,
+				path, static_cast<unsigned long long>(m.total_us / 1000000), static_cast<unsigned long long>(m.total_us % 1000000),
+				path, m.count,
+				path, m.errors);
+		}
+		if (!ok)
+			return WriteJsonError(rRequest.pBuffer, rRequest.pLength, "RESP_TOO_LARGE");
+		*rRequest.ppContentType = "text/plain; version=0.0.4";
+		*rRequest.pLength = static_cast<unsigned>(off);
 		return HTTPOK;
 	}
 
-	return HTTPNotFound;
+	bool ok = JsonAppend(out, cap, &off,
+		"{\"uptime_s\":%u,\"bytes_in\":%llu,\"bytes_out\":%llu,"
+		"\"sd_write\":{\"count\":%u,\"bytes\":%llu,\"us\":%llu,\"max_us\":%u,\"kbps\":%u},"
+		"\"crc\":{\"bytes\":%llu,\"us\":%llu,\"kbps\":%u},"
+		"\"commit\":{\"count\":%u,\"us\":%llu,\"max_us\":%u},"
+		"\"latency_buckets_ms\":[1,4,16,64,256,1024,4096],\"routes\":[",
+		uptime, static_cast<unsigned long long>(bytes_in), static_cast<unsigned long long>(bytes_out),
+		sd.count, static_cast<unsigned long long>(sd.bytes), static_cast<unsigned long long>(sd.total_us), sd.max_us, sd_kbps,
+		static_cast<unsigned long long>(g_crc_metrics.bytes), static_cast<unsigned long long>(g_crc_metrics.total_us), crc_kbps,
+		g_commit_metrics.count, static_cast<unsigned long long>(g_commit_metrics.total_us), g_commit_metrics.max_us);
+	bool first = true;
+	for (unsigned i = 0; ok && i <= routes; ++i)
+	{
+		const TRouteMetrics &m = g_route_metrics[i < routes ? i : kRouteMetricsMax - 1];
+		if (!m.count)
+			continue;
+		ok = JsonAppend(out, cap, &off,
+			"%s{\"path\":\"%s\",\"count\":%u,\"errors\":%u,\"bytes_in\":%llu,\"bytes_out\":%llu,"
+			"\"us\":%llu,\"max_us\":%u,\"hist\":[%u,%u,%u,%u,%u,%u,%u,%u]}",
+			first ? "" : ",", i < routes ? s_Routes[i].pPath : "other", m.count, m.errors,
+			static_cast<unsigned long long>(m.bytes_in), static_cast<unsigned long long>(m.bytes_out),
+			static_cast<unsigned long long>(m.total_us), m.max_us,
+			m.buckets[0], m.buckets[1], m.buckets[2], m.buckets[3],
+			m.buckets[4], m.buckets[5], m.buckets[6], m.buckets[7]);
+		first = false;
+	}
+	if (!ok || !JsonAppend(out, cap, &off, "]}"))
+		return WriteJsonError(rRequest.pBuffer, rRequest.pLength, "RESP_TOO_LARGE");
+	*rRequest.pLength = static_cast<unsigned>(off);
+	return HTTPOK;
+}
+
+// Boot-phase timeline of this boot (emulator, chainloader, service kernel):
+// stamps are microseconds since power-up; delta_us is from the previous phase.
+THTTPStatus CServiceHttpServer::RouteBootTime(const TRouteRequest &rRequest)
+{
+	char *out = reinterpret_cast<char *>(rRequest.pBuffer);
+	const size_t cap = static_cast<size_t>(*rRequest.pLength);
+	size_t off = 0;
+	const BootTimelineRecord *record = BootTimelineGet();
+
+	bool ok = JsonAppend(out, cap, &off, "{\"now_us\":%u,\"count\":%u,\"phases\":[",
+			     BootTimelineNow(), static_cast<unsigned>(record->count));
+	for (unsigned i = 0; ok && i < record->count; ++i)
+	{
+		const BootTimelineEntry &entry = record->entries[i];
+		const char *name = BootTimelinePhaseName(entry.phase);
+		char unknown[16];
+		if (!name)
+		{
+			snprintf(unknown, sizeof(unknown), "phase_%u", static_cast<unsigned>(entry.phase));
+			name = unknown;
+		}
+		const uint32_t delta = i ? entry.us - record->entries[i - 1].us : 0;
+		ok = JsonAppend(out, cap, &off,
+				"%s{\"phase\":\"%s\",\"stage\":\"%s\",\"t_us\":%u,\"delta_us\":%u,\"value\":%u}",
+				i ? "," : "", name, BootTimelineStageName(entry.phase),
+				static_cast<unsigned>(entry.us), static_cast<unsigned>(delta),
+				static_cast<unsigned>(entry.value));
+	}
+	if (!ok || !JsonAppend(out, cap, &off, "]}"))
+		return WriteJsonError(rRequest.pBuffer, rRequest.pLength, "RESP_TOO_LARGE");
+	*rRequest.pLength = static_cast<unsigned>(off);
+	return HTTPOK;
 }
@@ -8,6 +8,9 @@
 #define NETSERVICE_HTTP_SERVER_H
 
 #include <circle/net/httpdaemon.h>
+#include <fatfs/ff.h>
+
+#include "lz4_frame.h"
 
 class CServiceHttpServer : public CHTTPDaemon
 {
@@ -22,6 +25,10 @@ public:
 
 	CHTTPDaemon *CreateWorker(CNetSubSystem *pNetSubSystem, CSocket *pSocket) override;
 
+	// Worker instances serve their connection themselves (ServeConnection) so
+	// handlers can add response header fields; the listener runs as before.
+	void Run(void) override;
+
 	THTTPStatus GetContent(const char *pPath,
 			       const char *pParams,
 			       const char *pFormData,
@@ -29,10 +36,115 @@ public:
 			       unsigned *pLength,
 			       const char **ppContentType) override;
 
+protected:
+	// Upload bodies are streamed to /1541/_incoming/<name>.tmp as they arrive
+	// from the socket; HandleUpload() only verifies and renames the result.
+	boolean BeginRawBody(const char *pPath, unsigned nContentLength) override;
+	boolean ReceiveRawBody(const u8 *pData, unsigned nLength) override;
+
 private:
+	// GetContent() dispatch: s_Routes is sorted by path (strcmp order) and
+	// searched with normalized paths ("/x/" and "x" are "/x").
+	struct TRoute;
+	struct TRouteRequest
+	{
+		const TRoute *pRoute;
+		THTTPRequestMethod Method;
+		const char *pArg;		// rest of the path after a prefix route
+		const char *pParams;		// query string
+		u8 *pBuffer;
+		unsigned *pLength;
+		const char **ppContentType;
+	};
+	typedef THTTPStatus (CServiceHttpServer::*TRouteHandler)(const TRouteRequest &rRequest);
+	struct TRoute
+	{
+		const char *pPath;
+		unsigned nMethods;		// kMethod* bits
+		unsigned nFlags;		// kRoute* bits
+		TRouteHandler Handler;
+	};
+	static const TRoute s_Routes[];
+	static const TRoute *SearchRoutes(const char *pPath);
+	static const TRoute *FindRoute(const char *pURI, char *pPath, size_t nPathSize, const char **ppArg);
+
+	THTTPStatus RouteIndex(const TRouteRequest &rRequest);
+	THTTPStatus RouteFont(const TRouteRequest &rRequest);
+	THTTPStatus RouteHello(const TRouteRequest &rRequest);
+	THTTPStatus RouteModifiedList(const TRouteRequest &rRequest);
+	THTTPStatus RouteModifiedArchive(const TRouteRequest &rRequest);
+	THTTPStatus RouteModifiedDownload(const TRouteRequest &rRequest);
+	THTTPStatus RouteUpload(const TRouteRequest &rRequest);
+	THTTPStatus RouteUploadCommit(const TRouteRequest &rRequest);
+	THTTPStatus RouteActiveList(const TRouteRequest &rRequest);
+	THTTPStatus RouteActiveDownload(const TRouteRequest &rRequest);
+	THTTPStatus RouteMetrics(const TRouteRequest &rRequest);
+	THTTPStatus RouteBootTime(const TRouteRequest &rRequest);
+
 	THTTPStatus HandleUpload(u8 *pBuffer, unsigned *pLength, bool append_list, bool mark_complete);
+	THTTPStatus HandleUploadOffset(u8 *pBuffer, unsigned *pLength, bool append_list);
+	THTTPStatus WriteUploadError(u8 *pBuffer, unsigned *pLength, const char *error);
+	void ResolveUploadName(bool append_list, char *name, size_t name_len);
+	const char *BeginUpload(unsigned content_length, bool append_list);
+	bool WriteUploadData(const u8 *pData, unsigned nLength);
+	static bool DecodedUploadData(void *pContext, const u8 *pData, unsigned nLength);
+	bool FlushUpload(void);
+	void AbortUpload(void);
+
+	void ServeConnection(void);
+	void SendResponse(THTTPStatus status, const u8 *body, unsigned length, const char *content_type);
+	void AddResponseHeader(const char *fmt, ...);
+	bool SendData(CSocket *socket, const void *data, unsigned length);
+	THTTPStatus ServeFile(const char *path, bool lz4, unsigned *pLength, const char **ppContentType);
+	void SendFileLz4(CSocket *socket, unsigned length);
+	THTTPStatus ServeStatic(const u8 *data, unsigned size, const u8 *gz, unsigned gz_size,
+				uint32_t *pCrc, const char *cache_control, u8 *pBuffer, unsigned *pLength);
+	THTTPStatus ServeArchive(unsigned *pLength, const char **ppContentType);
+	void SendArchive(CSocket *socket);
 
 	CNetSubSystem *m_pNetSubSystem;
+	bool m_bWorker;
+
+	// Extra "Name: value\r\n" lines for the response being built.
+	char m_ResponseHeaders[512];
+	size_t m_nResponseHeadersLength;
+
+	// GET /metrics accounting of the request being served.
+	int m_nRouteIndex;		// into s_Routes, -1 if none matched
+	unsigned m_nBytesIn;		// request body bytes as received
+	unsigned m_nBytesOut;		// response bytes sent, header included
+
+	bool m_bSnapshotAfterResponse;	// /hello: take one pending dirty snapshot
+
+	// Streamed upload state of the request this worker is serving.
+	FIL m_UploadFile;
+	bool m_bUploadOpen;
+	bool m_bUploadChunked;
+	const char *m_pUploadError;
+	char m_UploadName[64];
+	char m_UploadTempPath[256];
+	uint32_t m_nUploadOffset;	// where this request's bytes start in the file
+	uint32_t m_nUploadTotal;	// X-Image-Size
+	uint32_t m_nUploadCrc;		// whole file, running
+	uint32_t m_nChunkCrc;		// this request's bytes, running
+	uint32_t m_nChunkExpectedCrc;
+	unsigned m_nUploadSize;		// bytes received by this request
+	unsigned m_nUploadBuffered;
+	CLz4FrameDecoder *m_pUploadDecoder;	// Content-Encoding: lz4
+
+	// Response body streamed from SD instead of the content buffer.
+	FIL m_ResponseFile;
+	bool m_bResponseFile;
+	CLz4FrameEncoder *m_pResponseEncoder;	// set: body is an LZ4 frame, no Content-Length
+
+	// GET /modified/archive: files and sizes fixed when the header was sent.
+	static constexpr unsigned kArchiveMax = 32;
+	unsigned m_nArchiveCount;
+	uint32_t m_ArchiveSize[kArchiveMax];
+	uint32_t m_ArchiveTime[kArchiveMax];
+
+	// SD I/O block: upload staging, download streaming, file CRCs.
+	u8 m_IoBuffer[4096];
 };
 
 #endif
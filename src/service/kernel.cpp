@@ -11,6 +11,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#include "boot_timeline.h"
 #include "service.h"
 #include "shim.h"
 #include "options.h"
@@ -47,6 +48,8 @@ void CServiceKernel::log(const char *fmt, ...)
 
 boolean CServiceKernel::Initialize(void)
 {
+	const unsigned start = BootTimelineNow();
+
 	// Serial is our fallback logging target until the OLED is up.
 	const boolean serialOK = m_Serial.Initialize(115200);
 
@@ -80,6 +83,11 @@ boolean CServiceKernel::Initialize(void)
 	}
 
 	m_Logger.Write("service", LogNotice, "mounted drive: %s", _DRIVE);
+
+	// Continue the timeline the emulator and chainloader saved.
+	BootTimelineLoad();
+	BootTimelineMarkAt(BOOT_PHASE_SRV_START, start);
+	BootTimelineMark(BOOT_PHASE_SRV_FAT_MOUNT);
 	return TRUE;
 }
 
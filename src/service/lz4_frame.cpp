@@ -0,0 +1,267 @@
+// service/lz4_frame.cpp - streaming LZ4 frame codec for service HTTP transfers.
+
+#include "lz4_frame.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const u8 kFrameMagic[4] = { 0x04, 0x22, 0x4D, 0x18 };
+
+// FLG: version 01, independent blocks, no checksums. BD: 64 KB blocks.
+// The last byte is the header checksum, (XXH32(FLG, BD) >> 8) & 0xFF.
+static const u8 kEncoderHeader[CLz4FrameEncoder::HeaderSize] = { 0x04, 0x22, 0x4D, 0x18, 0x60, 0x40, 0x82 };
+
+static uint32_t GetLE32(const u8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void PutLE32(u8 *p, uint32_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = v >> 24;
+}
+
+CLz4FrameDecoder::CLz4FrameDecoder(void)
+	: m_State(StateHeader),
+	  m_bComplete(false),
+	  m_nHeaderLength(0),
+	  m_nHave(0),
+	  m_bBlockChecksum(false),
+	  m_bContentChecksum(false),
+	  m_bBlockRaw(false),
+	  m_nBlockSize(0),
+	  m_pBuffer(nullptr),
+	  m_nOutput(0)
+{
+}
+
+CLz4FrameDecoder::~CLz4FrameDecoder(void)
+{
+	free(m_pBuffer);
+}
+
+bool CLz4FrameDecoder::Initialize(void)
+{
+	if (!m_pBuffer)
+		m_pBuffer = static_cast<u8 *>(malloc(3 * kBlockMax));
+	return m_pBuffer != nullptr;
+}
+
+bool CLz4FrameDecoder::IsComplete(void) const
+{
+	return m_bComplete && m_State == StateHeader && m_nHave == 0;
+}
+
+bool CLz4FrameDecoder::ParseHeader(void)
+{
+	const u8 flg = m_Header[4];
+	const u8 bd = m_Header[5];
+	if ((flg >> 6) != 1)
+		return false; // version
+	if (flg & 0x01)
+		return false; // dictionary ID: no dictionaries here
+	if (((bd >> 4) & 7) != 4)
+		return false; // only 64 KB blocks (lz4 -B4) fit the buffers
+
+	m_bBlockChecksum = (flg & 0x10) != 0;
+	m_bContentChecksum = (flg & 0x04) != 0;
+	m_nOutput = 0;
+	LZ4_setStreamDecode(&m_Stream, nullptr, 0);
+	return true;
+}
+
+bool CLz4FrameDecoder::DecodeBlock(TOutputHandler *pHandler, void *pContext)
+{
+	// Alternate between two output blocks: the previous one stays in place as
+	// the 64 KB history linked blocks may refer to.
+	u8 *in = m_pBuffer;
+	u8 *out = m_pBuffer + (1 + m_nOutput) * kBlockMax;
+	int length;
+	if (m_bBlockRaw)
+	{
+		memcpy(out, in, m_nBlockSize);
+		length = static_cast<int>(m_nBlockSize);
+		LZ4_setStreamDecode(&m_Stream, reinterpret_cast<const char *>(out), length);
+	}
+	else
+	{
+		length = LZ4_decompress_safe_continue(&m_Stream, reinterpret_cast<const char *>(in),
+						      reinterpret_cast<char *>(out),
+						      static_cast<int>(m_nBlockSize), kBlockMax);
+		if (length < 0)
+			return false;
+	}
+	m_nOutput ^= 1;
+	return length == 0 || pHandler(pContext, out, static_cast<unsigned>(length));
+}
+
+bool CLz4FrameDecoder::Write(const u8 *pData, unsigned nLength, TOutputHandler *pHandler, void *pContext)
+{
+	if (!m_pBuffer)
+		return false;
+
+	while (nLength)
+	{
+		switch (m_State)
+		{
+		case StateHeader:
+		{
+			// Magic, FLG and BD first; then the rest, whose size FLG gives.
+			const unsigned want = m_nHave < 6 ? 6 : m_nHeaderLength;
+			unsigned take = want - m_nHave;
+			if (take > nLength)
+				take = nLength;
+			memcpy(m_Header + m_nHave, pData, take);
+			m_nHave += take;
+			pData += take;
+			nLength -= take;
+			if (m_nHave < want)
+				break;
+
+			if (m_nHave == 6)
+			{
+				if (memcmp(m_Header, kFrameMagic, 4) != 0)
+					return false;
+				m_nHeaderLength = 7 + (m_Header[4] & 0x08 ? 8 : 0) + (m_Header[4] & 0x01 ? 4 : 0);
+				break;
+			}
+			if (!ParseHeader())
+				return false;
+			m_nHave = 0;
+			m_State = StateBlockSize;
+			break;
+		}
+
+		case StateBlockSize:
+		case StateBlockChecksum:
+		case StateContentChecksum:
+		{
+			unsigned take = 4 - m_nHave;
+			if (take > nLength)
+				take = nLength;
+			memcpy(m_Field + m_nHave, pData, take);
+			m_nHave += take;
+			pData += take;
+			nLength -= take;
+			if (m_nHave < 4)
+				break;
+			m_nHave = 0;
+
+			if (m_State == StateBlockChecksum)
+			{
+				m_State = StateBlockSize;
+				break;
+			}
+			if (m_State == StateContentChecksum)
+			{
+				m_bComplete = true;
+				m_State = StateHeader;
+				break;
+			}
+
+			const uint32_t word = GetLE32(m_Field);
+			if (word == 0)
+			{
+				// EndMark
+				if (m_bContentChecksum)
+				{
+					m_State = StateContentChecksum;
+				}
+				else
+				{
+					m_bComplete = true;
+					m_State = StateHeader;
+				}
+				break;
+			}
+			m_bBlockRaw = (word & 0x80000000U) != 0;
+			m_nBlockSize = word & 0x7FFFFFFFU;
+			if (m_nBlockSize > kBlockMax)
+				return false;
+			m_bComplete = false;
+			m_State = StateBlockData;
+			break;
+		}
+
+		case StateBlockData:
+		{
+			unsigned take = m_nBlockSize - m_nHave;
+			if (take > nLength)
+				take = nLength;
+			memcpy(m_pBuffer + m_nHave, pData, take);
+			m_nHave += take;
+			pData += take;
+			nLength -= take;
+			if (m_nHave < m_nBlockSize)
+				break;
+			m_nHave = 0;
+
+			if (!DecodeBlock(pHandler, pContext))
+				return false;
+			m_State = m_bBlockChecksum ? StateBlockChecksum : StateBlockSize;
+			break;
+		}
+		}
+	}
+	return true;
+}
+
+CLz4FrameEncoder::CLz4FrameEncoder(void)
+	: m_pState(nullptr),
+	  m_pInput(nullptr),
+	  m_pOutput(nullptr)
+{
+}
+
+CLz4FrameEncoder::~CLz4FrameEncoder(void)
+{
+	free(m_pState);
+	free(m_pInput);
+	free(m_pOutput);
+}
+
+bool CLz4FrameEncoder::Initialize(void)
+{
+	// Heap state: LZ4_compress_default() would put 16 KB on the task stack.
+	if (!m_pState)
+		m_pState = malloc(static_cast<size_t>(LZ4_sizeofState()));
+	if (!m_pInput)
+		m_pInput = static_cast<u8 *>(malloc(BlockSize));
+	if (!m_pOutput)
+		m_pOutput = static_cast<u8 *>(malloc(4 + LZ4_COMPRESSBOUND(BlockSize)));
+	return m_pState && m_pInput && m_pOutput;
+}
+
+const u8 *CLz4FrameEncoder::Begin(unsigned *pLength)
+{
+	*pLength = HeaderSize;
+	return kEncoderHeader;
+}
+
+const u8 *CLz4FrameEncoder::Block(unsigned nLength, unsigned *pLength)
+{
+	const int packed = LZ4_compress_fast_extState(m_pState, reinterpret_cast<const char *>(m_pInput),
+						      reinterpret_cast<char *>(m_pOutput + 4),
+						      static_cast<int>(nLength), LZ4_COMPRESSBOUND(BlockSize), 1);
+	if (packed <= 0 || static_cast<unsigned>(packed) >= nLength)
+	{
+		// Incompressible: store the block as is.
+		PutLE32(m_pOutput, 0x80000000U | nLength);
+		memcpy(m_pOutput + 4, m_pInput, nLength);
+		*pLength = 4 + nLength;
+		return m_pOutput;
+	}
+	PutLE32(m_pOutput, static_cast<uint32_t>(packed));
+	*pLength = 4 + static_cast<unsigned>(packed);
+	return m_pOutput;
+}
+
+const u8 *CLz4FrameEncoder::End(unsigned *pLength)
+{
+	PutLE32(m_pOutput, 0);
+	*pLength = EndSize;
+	return m_pOutput;
+}
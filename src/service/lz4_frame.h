@@ -0,0 +1,93 @@
+// service/lz4_frame.h - streaming LZ4 frame codec for service HTTP transfers.
+//
+// Only the part of the LZ4 frame format the service needs:
+// - decoder: 64 KB block frames (lz4 -B4), linked or independent blocks,
+//   fed in arbitrary pieces as they arrive from the socket
+// - encoder: independent 16 KB blocks, no checksums
+// Header, block and content checksums are skipped on decode; uploads are
+// verified with X-CRC32 over the decoded bytes instead.
+
+#ifndef NETSERVICE_LZ4_FRAME_H
+#define NETSERVICE_LZ4_FRAME_H
+
+#include <circle/types.h>
+
+#include "vendors/lz4/lz4.h"
+
+class CLz4FrameDecoder
+{
+public:
+	// Receives decoded bytes; returning false stops decoding.
+	typedef bool TOutputHandler(void *pContext, const u8 *pData, unsigned nLength);
+
+	CLz4FrameDecoder(void);
+	~CLz4FrameDecoder(void);
+
+	// Allocates the block buffers (192 KB).
+	bool Initialize(void);
+
+	// Returns false on a malformed or unsupported frame, or if pHandler failed.
+	bool Write(const u8 *pData, unsigned nLength, TOutputHandler *pHandler, void *pContext);
+
+	// True between frames, once at least one frame has been decoded.
+	bool IsComplete(void) const;
+
+private:
+	static constexpr unsigned kBlockMax = 64 * 1024;
+
+	enum TState
+	{
+		StateHeader,
+		StateBlockSize,
+		StateBlockData,
+		StateBlockChecksum,
+		StateContentChecksum
+	};
+
+	bool ParseHeader(void);
+	bool DecodeBlock(TOutputHandler *pHandler, void *pContext);
+
+	TState m_State;
+	bool m_bComplete;
+	u8 m_Header[19];
+	unsigned m_nHeaderLength;	// wanted, known once FLG has been read
+	unsigned m_nHave;		// bytes collected for the current field
+	u8 m_Field[4];
+	bool m_bBlockChecksum;
+	bool m_bContentChecksum;
+	bool m_bBlockRaw;
+	unsigned m_nBlockSize;
+
+	u8 *m_pBuffer;			// input block, then two output blocks
+	unsigned m_nOutput;		// output block being written (0/1)
+	LZ4_streamDecode_t m_Stream;
+};
+
+class CLz4FrameEncoder
+{
+public:
+	static constexpr unsigned BlockSize = 16 * 1024;
+	static constexpr unsigned HeaderSize = 7;
+	static constexpr unsigned EndSize = 4;
+
+	CLz4FrameEncoder(void);
+	~CLz4FrameEncoder(void);
+
+	// Allocates the compression state and block buffers.
+	bool Initialize(void);
+
+	// Buffer for up to BlockSize input bytes.
+	u8 *GetInputBuffer(void) const { return m_pInput; }
+
+	// Each returns the output bytes, valid until the next call.
+	const u8 *Begin(unsigned *pLength);
+	const u8 *Block(unsigned nLength, unsigned *pLength);	// from GetInputBuffer()
+	const u8 *End(unsigned *pLength);
+
+private:
+	void *m_pState;
+	u8 *m_pInput;
+	u8 *m_pOutput;
+};
+
+#endif
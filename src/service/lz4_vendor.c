@@ -0,0 +1,6 @@
+// service/lz4_vendor.c - vendored LZ4 built into the service kernel.
+//
+// Compiled from here rather than as vendors/lz4/lz4.o, which belongs to the
+// legacy chainloader build and its compiler flags.
+
+#include "vendors/lz4/lz4.c"
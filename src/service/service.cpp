@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "boot_timeline.h"
 #include "http_server.h"
 #include "kernel.h"
 #include "options.h"
@@ -149,6 +150,7 @@ static void ServiceLoadOptions(void)
 	f_close(&fp);
 
 	g_options.Process((char *) buf);
+	BootTimelineMark(BOOT_PHASE_SRV_OPTIONS);
 	Kernel.log("service: options loaded");
 }
 
@@ -204,6 +206,8 @@ void service_init(void)
 		return;
 	}
 
+	BootTimelineMark(BOOT_PHASE_SRV_WLAN_INIT);
+
 	// Do not block service boot on link/DHCP; service_run() handles async readiness.
 	ServiceEnsureLCD();
 	ServiceDrawReadyScreen("IP: (joining)");
@@ -259,6 +263,9 @@ bool service_run(void)
 	const bool useDhcp = g_options.GetDHCP();
 	unsigned retryCount = 0;
 	bool allowStatusLog = true;
+	bool timelineLink = false;
+	bool timelineIp = false;
+	bool timelineHttp = false;
 
 	// OLED transition model:
 	// JOINING -> (ASSOC/DHCP timeout) -> ERR code flash -> ERR: RETRY 30S -> JOINING
@@ -355,6 +362,18 @@ bool service_run(void)
 		const bool netRunning = net && net->IsRunning();
 		const bool ipReady = netRunning && !net->GetConfig()->GetIPAddress()->IsNull();
 
+		// Boot timeline, at the resolution of this poll loop.
+		if (linkUp && !timelineLink)
+		{
+			BootTimelineMark(BOOT_PHASE_SRV_WLAN_UP);
+			timelineLink = true;
+		}
+		if (ipReady && !timelineIp)
+		{
+			BootTimelineMark(BOOT_PHASE_SRV_DHCP, useDhcp ? 1 : 0);
+			timelineIp = true;
+		}
+
 		// Start HTTP only after both link and IP are ready.
 		if (!g_http_server && linkUp && ipReady)
 		{
@@ -375,6 +394,13 @@ bool service_run(void)
 			}
 		}
 
+		if (g_http_server && !timelineHttp)
+		{
+			BootTimelineMark(BOOT_PHASE_SRV_HTTP_READY);
+			BootTimelineSave();
+			timelineHttp = true;
+		}
+
 		if (!linkUp || !ipReady)
 		{
 			const bool inErrFlash = ui.errShowMs != 0;
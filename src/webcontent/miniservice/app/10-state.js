@@ -7,6 +7,7 @@ var NAME_MAX = GRID_COLS - 6;
 var LIST_FRAME_WIDTH = GRID_COLS;
 var FRAME_VL = "\uE0C2";
 var POLL_MS = 1000;
+var METRICS_POLL_MS = 5000;
 var HELLO_TIMEOUT_MS = 1500;
 var SUCCESS_MS = 5000;
 var STATUS_CYCLE_MS = 3000;
@@ -47,6 +48,8 @@ var ready = false;
 var waitingForReconnect = false;
 var waitingSince = 0;
 var uploading = false;
+var metricsInFlight = false;
+var lastMetrics = null;
 var lastNonce = 0;
 var successUntil = 0;
 var errorUntil = 0;
@@ -65,6 +68,7 @@ var fileInput = document.getElementById("fileInput");
 var folderInput = document.getElementById("folderInput");
 var listEl = document.getElementById("list");
 var statusLine = document.getElementById("statusLine");
+var metricsLine = document.getElementById("metricsLine");
 var statusValue = document.getElementById("statusValue");
 var actionLine1 = document.getElementById("actionLine1");
 var actionLine2 = document.getElementById("actionLine2");
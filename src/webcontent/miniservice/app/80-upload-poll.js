@@ -1,3 +1,119 @@
+var UPLOAD_CHUNK = 64 * 1024;
+var UPLOAD_RETRIES = 5;
+
+function hex32(v) {
+  return "0x" + (v >>> 0).toString(16).padStart(8, "0");
+}
+
+// One chunk as an LZ4 frame (single independent block, no checksums) for
+// Content-Encoding: lz4 uploads; null when that would not be smaller.
+function lz4Frame(src) {
+  var n = src.length;
+  var out = new Uint8Array(n + 16);
+  var table = new Int32Array(4096).fill(-1);
+  var op = 11;
+  var anchor = 0;
+  var ip = 0;
+
+  function len(v) {
+    while (v >= 255) { out[op++] = 255; v -= 255; }
+    out[op++] = v;
+  }
+  function emit(end, mlen, dist) {
+    var l = end - anchor;
+    if (op + l + 9 + (l / 255 | 0) + (mlen / 255 | 0) > n) return false;
+    out[op++] = (Math.min(l, 15) << 4) | (mlen ? Math.min(mlen - 4, 15) : 0);
+    if (l >= 15) len(l - 15);
+    out.set(src.subarray(anchor, end), op);
+    op += l;
+    if (mlen) {
+      out[op++] = dist & 255;
+      out[op++] = dist >> 8;
+      if (mlen >= 19) len(mlen - 19);
+    }
+    return true;
+  }
+
+  // Greedy matches; the format wants the last 5 bytes as literals and no
+  // match starting in the last 12.
+  while (ip + 12 <= n) {
+    var h = Math.imul(src[ip] | (src[ip + 1] << 8) | (src[ip + 2] << 16) | (src[ip + 3] << 24), 2654435761) >>> 20;
+    var ref = table[h];
+    table[h] = ip;
+    if (ref < 0 || ip - ref > 65535 || src[ref] !== src[ip] || src[ref + 1] !== src[ip + 1] ||
+        src[ref + 2] !== src[ip + 2] || src[ref + 3] !== src[ip + 3]) {
+      ip++;
+      continue;
+    }
+    var m = 4;
+    while (ip + m < n - 5 && src[ref + m] === src[ip + m]) m++;
+    if (!emit(ip, m, ip - ref)) return null;
+    ip += m;
+    anchor = ip;
+  }
+  if (!emit(n, 0, 0)) return null;
+
+  var block = op - 11;
+  out.set([0x04, 0x22, 0x4D, 0x18, 0x60, 0x40, 0x82, block & 255, (block >> 8) & 255, block >> 16, 0], 0);
+  out.set([0, 0, 0, 0], op);
+  return out.subarray(0, op + 4);
+}
+
+// Sends one file in chunks; after a dropped request it asks the Pi how much
+// arrived (GET on the upload URL) and resends only the rest.
+function uploadFile(item, nonce) {
+  var data = item.data;
+  var size = data.length;
+  var headers = {
+    "Content-Type": "application/octet-stream",
+    "X-Nonce": String(nonce),
+    "X-Image-Size": String(size),
+    "X-CRC32": hex32(crc32(data)),
+    "X-Image-Name": item.name
+  };
+  var retries = 0;
+
+  function retry(offset) {
+    if (++retries > UPLOAD_RETRIES) throw new Error("upload failed");
+    if (offset !== undefined) return send(offset);
+    return fetch("/upload/active/add", {
+      headers: { "X-Image-Name": item.name },
+      cache: "no-store"
+    }).then(function(resp) {
+      return resp.json();
+    }).then(function(j) {
+      return send(j.offset || 0);
+    }, function() {
+      return retry();
+    });
+  }
+
+  function send(offset) {
+    var chunk = data.subarray(offset, Math.min(size, offset + UPLOAD_CHUNK));
+    var h = Object.assign({}, headers, {
+      "X-Upload-Offset": String(offset),
+      "X-Chunk-CRC32": hex32(crc32(chunk))
+    });
+    var packed = lz4Frame(chunk);
+    if (packed) h["Content-Encoding"] = "lz4";
+    return fetch("/upload/active/add", { method: "PUT", headers: h, body: packed || chunk }).then(function(resp) {
+      if (!resp.ok) throw new Error("upload failed");
+      return resp.json();
+    }).then(function(j) {
+      if (j.ok) {
+        retries = 0;
+        return j.complete ? j : send(j.offset);
+      }
+      if (j.error === "BAD_OFFSET" || j.error === "BAD_CHUNK_CRC") return retry(j.offset);
+      throw new Error(j.error || "upload failed");
+    }, function() {
+      return retry();
+    });
+  }
+
+  return send(0);
+}
+
 function uploadQueue() {
   if (!ready || uploading || queue.length === 0) return;
   uploading = true;
@@ -8,22 +124,7 @@ function uploadQueue() {
 
   queue.forEach(function(item) {
     chain = chain.then(function() {
-      var size = item.data.length;
-      var crc = crc32(item.data);
-      return fetch("/upload/active/add", {
-        method: "PUT",
-        headers: {
-          "Content-Type": "application/octet-stream",
-          "X-Nonce": String(nonce),
-          "X-Image-Size": String(size),
-          "X-CRC32": "0x" + crc.toString(16).padStart(8, "0"),
-          "X-Image-Name": item.name
-        },
-        body: item.data
-      }).then(function(resp) {
-        if (!resp.ok) throw new Error("upload failed");
-        return resp.json().catch(function() { return {}; });
-      });
+      return uploadFile(item, nonce);
     });
   });
 
@@ -171,3 +272,25 @@ function pollHello() {
     renderDirtyModal();
   });
 }
+
+// SD write rate (since boot) and network rate (since the last poll) from
+// GET /metrics; skipped while uploading so it never competes for the socket.
+function pollMetrics() {
+  if (uploading || !ready || metricsInFlight) return;
+  metricsInFlight = true;
+  fetch("/metrics", { cache: "no-store" }).then(function(r) {
+    if (!r.ok) throw new Error("no metrics");
+    return r.json();
+  }).then(function(m) {
+    var net = 0;
+    if (lastMetrics && m.uptime_s > lastMetrics.uptime_s)
+      net = (m.bytes_in + m.bytes_out - lastMetrics.bytes_in - lastMetrics.bytes_out) / 1024 / (m.uptime_s - lastMetrics.uptime_s);
+    lastMetrics = m;
+    var sd = m.sd_write && m.sd_write.count ? m.sd_write.kbps + " KB/S" : "--";
+    metricsLine.textContent = "SD WRITE: " + sd + "  NET: " + Math.round(net) + " KB/S";
+  }).catch(function() {
+    metricsLine.textContent = "";
+  }).finally(function() {
+    metricsInFlight = false;
+  });
+}
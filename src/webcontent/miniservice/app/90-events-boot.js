@@ -80,6 +80,7 @@ folderInput.addEventListener("change", function(e) {
 });
 
 setInterval(pollHello, POLL_MS);
+setInterval(pollMetrics, METRICS_POLL_MS);
 setInterval(renderStatus, 250);
 setInterval(tickStatusCycle, 50);
 renderAll();
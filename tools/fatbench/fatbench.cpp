@@ -0,0 +1,169 @@
+/*
+ * fatbench.cpp
+ *
+ * Reads files from a FAT/exFAT image (a raw dump of the SD card or of one
+ * partition) through src/ff.cpp, built with the same ffconf-local.h as the
+ * emulator and chainloader, and reports the disk_read() requests FatFs
+ * issues. On the Pi each request is one EMMC command, so the request count,
+ * not the byte count, dominates the load time of a fresh image.
+ *
+ * Usage: fatbench [-c bytes] image file...
+ *
+ *   -c  f_read() size (default: whole file in one call, like DiskCaddy and
+ *       the chainloader do)
+ *
+ * "mergeable" counts requests that start right where the previous one
+ * ended. With _FS_READ_COALESCE enabled, only f_read() call boundaries (-c)
+ * and the single-sector reads of unaligned heads and tails should be left.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ff-local.h"
+#include "diskio.h"
+
+static FILE *image;
+
+static unsigned long reads;
+static unsigned long long sectors;
+static unsigned long mergeable;
+static unsigned long largest;
+static DWORD next_sector = 0xffffffff;
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+	return pdrv == 0 && image ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_status (BYTE pdrv)
+{
+	return disk_initialize (pdrv);
+}
+
+DRESULT disk_read (BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+	if (pdrv != 0 || !image)
+		return RES_PARERR;
+
+	reads++;
+	sectors += count;
+	if (sector == next_sector)
+		mergeable++;
+	if (count > largest)
+		largest = count;
+	next_sector = sector + count;
+
+	if (fseeko (image, (off_t) sector * 512, SEEK_SET) != 0
+	    || fread (buff, 512, count, image) != count)
+		return RES_ERROR;
+	return RES_OK;
+}
+
+DRESULT disk_write (BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+	(void) pdrv;
+	(void) buff;
+	(void) sector;
+	(void) count;
+	return RES_WRPRT;
+}
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void *buff)
+{
+	(void) pdrv;
+	(void) buff;
+	return cmd == CTRL_SYNC ? RES_OK : RES_PARERR;
+}
+
+static void reset_counters (void)
+{
+	reads = 0;
+	sectors = 0;
+	mergeable = 0;
+	largest = 0;
+	next_sector = 0xffffffff;
+}
+
+int main (int argc, char **argv)
+{
+	const char *prog = argv[0];
+	unsigned chunk = 0;
+
+	if (argc >= 3 && strcmp (argv[1], "-c") == 0)
+	{
+		chunk = (unsigned) strtoul (argv[2], 0, 0);
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc < 3)
+	{
+		fprintf (stderr, "\nUsage: %s [-c bytes] image file...\n\n", prog);
+		return 1;
+	}
+
+	image = fopen (argv[1], "rb");
+	if (!image)
+	{
+		fprintf (stderr, "\n%s: Cannot open %s\n\n", prog, argv[1]);
+		return 1;
+	}
+
+	static FATFS fs;
+	FRESULT res = f_mount (&fs, "SD:", 1);
+	if (res != FR_OK)
+	{
+		fprintf (stderr, "\n%s: Cannot mount %s (%d)\n\n", prog, argv[1], res);
+		return 1;
+	}
+	printf ("cluster %u sectors, _FS_READ_COALESCE %u\n\n", (unsigned) fs.csize, (unsigned) _FS_READ_COALESCE);
+	printf ("%-32s %10s %8s %10s %8s %9s %8s\n", "file", "bytes", "reads", "sectors", "largest", "mergeable", "ms");
+
+	int status = 0;
+	for (int i = 2; i < argc; ++i)
+	{
+		char path[512];
+		snprintf (path, sizeof path, "SD:/%s", argv[i]);
+
+		FIL file;
+		if (f_open (&file, path, FA_READ) != FR_OK)
+		{
+			fprintf (stderr, "%s: Cannot open %s\n", prog, argv[i]);
+			status = 1;
+			continue;
+		}
+
+		const unsigned size = (unsigned) f_size (&file);
+		const unsigned step = chunk ? chunk : (size ? size : 1);
+		BYTE *buffer = (BYTE *) aligned_alloc (64, (step + 63) & ~63u);
+		reset_counters ();
+
+		struct timespec start, end;
+		clock_gettime (CLOCK_MONOTONIC, &start);
+		unsigned total = 0;
+		UINT br;
+		do
+		{
+			res = f_read (&file, buffer, step, &br);
+			total += br;
+		}
+		while (res == FR_OK && br == step);
+		clock_gettime (CLOCK_MONOTONIC, &end);
+		f_close (&file);
+		free (buffer);
+
+		if (res != FR_OK || total != size)
+		{
+			fprintf (stderr, "%s: Read error on %s (%d)\n", prog, argv[i], res);
+			status = 1;
+			continue;
+		}
+		const double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+		printf ("%-32s %10u %8lu %10llu %8lu %9lu %8.2f\n", argv[i], size, reads, sectors, largest, mergeable, ms);
+	}
+
+	fclose (image);
+	return status;
+}